@@ -65,7 +65,7 @@ esp_err_t sd_spi_config(uint8_t spi_host, uint8_t cs_pin) {
 	ESP_LOGI(TAG_SF, "Mounting filesystem");
 	esp_vfs_fat_sdmmc_mount_config_t mount_config = {
 		.format_if_mount_failed = false,
-		.max_files = 5,
+		.max_files = SD_MAX_FILES,
 		.allocation_unit_size = 16 * 1024
 	};
 
@@ -7,6 +7,7 @@
 #include "esp_log.h"
 
 #define SD_POINT "/sdcard"
+#define SD_MAX_FILES 8		// FATFS open files limit (shared by logs, http and series handles)
 static const char *TAG_SF = "#FS";
 
 // Color macros
@@ -0,0 +1,202 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_http_server.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+
+static const char *TAG_STREAM = "#STREAM";
+
+// ============================================================================
+// HTTP STREAM: double buffered read / send pipeline for file downloads
+// ============================================================================
+// why: fread (~3ms per 4KB) and httpd_resp_send_chunk alternate, SD and wifi are never busy together
+// a reader task fills one buffer while the httpd task sends the other: the download takes
+// about max(SD, TCP) instead of the sum of both
+// streams come from a small pool (HTTP_STREAM_SLOTS): one reader task and two buffers each
+//   empty queue: buffers the reader may fill, filled queue: chunks the httpd task sends
+//   a chunk of len <= 0 ends the stream (0: end of data, -1: read error)
+// the caller holds the FS access for the whole stream: the reader works under it
+// no pool (not started / out of memory): the chunks are read and sent inline on the caller buffer
+
+#define HTTP_STREAM_CHUNK 4096
+#define HTTP_STREAM_BUFFERS 2
+#define HTTP_STREAM_WAIT_MS 1000				// wait for a free stream, then inline
+#define HTTP_STREAM_TASK_STACK 4096
+#define HTTP_STREAM_TASK_PRIORITY 5				// as the httpd task
+
+// fill buffer with up to size bytes: returns the bytes, 0 at the end, -1 on a read error
+typedef int (*http_fill_fn)(void *ctx, char *buffer, size_t size);
+
+typedef struct {
+	int index;							// buffer
+	int len;							// <= 0: end of the stream
+} http_chunk_t;
+
+typedef struct {
+	TaskHandle_t task;
+	QueueHandle_t empty;				// int: buffers to fill (httpd -> reader)
+	QueueHandle_t filled;				// http_chunk_t: buffers to send (reader -> httpd)
+	http_fill_fn fill;
+	void *ctx;
+	int abort;							// atomic - the response failed: the reader stops at its next chunk
+	uint32_t read_us;
+	char buffer[HTTP_STREAM_BUFFERS][HTTP_STREAM_CHUNK];
+} http_stream_t;
+
+typedef struct {
+	uint32_t streams;
+	uint32_t inline_streams;			// no free stream: read and sent in turn
+	uint32_t aborted;
+	uint64_t bytes;
+	uint64_t read_us;					// reader busy
+	uint64_t send_us;					// httpd busy sending
+	uint64_t total_us;					// wall time: below read + send when they overlap
+} http_stream_stats_t;
+
+static http_stream_stats_t http_stream_stats = {0};
+static QueueHandle_t HTTP_STREAM_POOL = NULL;		// http_stream_t*: the free streams
+static int HTTP_STREAM_COUNT = 0;
+
+static void http_stream_task(void *arg) {
+	http_stream_t *stream = (http_stream_t*)arg;
+
+	for (;;) {
+		ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+		int len;
+
+		do {
+			http_chunk_t chunk;
+			xQueueReceive(stream->empty, &chunk.index, portMAX_DELAY);
+
+			int64_t start = esp_timer_get_time();
+			const int aborted = __atomic_load_n(&stream->abort, __ATOMIC_RELAXED);
+			len = aborted ? 0 : stream->fill(stream->ctx, stream->buffer[chunk.index], HTTP_STREAM_CHUNK);
+			stream->read_us += esp_timer_get_time() - start;
+
+			chunk.len = len;
+			xQueueSend(stream->filled, &chunk, portMAX_DELAY);
+		} while (len > 0);
+	}
+}
+
+//* @brief Create slots streams (reader task + 2 x 4KB each), returns the streams available
+static int http_stream_start(int slots) {
+	const char method_name[] = "http_stream_start";
+	if (HTTP_STREAM_POOL) return HTTP_STREAM_COUNT;
+
+	HTTP_STREAM_POOL = xQueueCreate(slots, sizeof(http_stream_t*));
+	if (!HTTP_STREAM_POOL) return 0;
+
+	for (int i = 0; i < slots; i++) {
+		http_stream_t *stream = calloc(1, sizeof(http_stream_t));
+		if (!stream) break;
+
+		stream->empty = xQueueCreate(HTTP_STREAM_BUFFERS, sizeof(int));
+		stream->filled = xQueueCreate(HTTP_STREAM_BUFFERS, sizeof(http_chunk_t));
+
+		if (!stream->empty || !stream->filled ||
+			xTaskCreate(http_stream_task, "http_stream", HTTP_STREAM_TASK_STACK,
+						stream, HTTP_STREAM_TASK_PRIORITY, &stream->task) != pdPASS
+		) {
+			ESP_LOGE(TAG_STREAM, "%s STREAM-FAILED %d", method_name, i);
+			if (stream->empty) vQueueDelete(stream->empty);
+			if (stream->filled) vQueueDelete(stream->filled);
+			free(stream);
+			break;
+		}
+
+		xQueueSend(HTTP_STREAM_POOL, &stream, 0);
+		HTTP_STREAM_COUNT++;
+	}
+
+	ESP_LOGI(TAG_STREAM, "%s STARTED %d streams", method_name, HTTP_STREAM_COUNT);
+	return HTTP_STREAM_COUNT;
+}
+
+// no stream: fill and send in turn on buffer (HTTP_STREAM_CHUNK bytes)
+static int http_stream_inline(httpd_req_t *req, http_fill_fn fill, void *ctx, char *buffer, uint64_t *send_us) {
+	int total = 0, len;
+
+	while ((len = fill(ctx, buffer, HTTP_STREAM_CHUNK)) > 0) {
+		int64_t start = esp_timer_get_time();
+		esp_err_t ret = httpd_resp_send_chunk(req, buffer, len);
+		*send_us += esp_timer_get_time() - start;
+
+		if (ret != ESP_OK) return -1;
+		total += len;
+	}
+	return len < 0 ? -1 : total;
+}
+
+//* @brief Send the chunks of fill as they are read, returns the bytes sent or -1 (read or send failed)
+// buffer (HTTP_STREAM_CHUNK bytes): used when no stream is free
+static int http_stream_send(httpd_req_t *req, http_fill_fn fill, void *ctx, char *buffer) {
+	const char method_name[] = "http_stream_send";
+	http_stream_t *stream = NULL;
+	uint64_t send_us = 0;
+	int64_t started = esp_timer_get_time();
+	int total = 0, failed = 0;
+
+	if (!HTTP_STREAM_POOL || xQueueReceive(HTTP_STREAM_POOL, &stream, pdMS_TO_TICKS(HTTP_STREAM_WAIT_MS)) != pdTRUE) {
+		int64_t start = esp_timer_get_time();
+		total = http_stream_inline(req, fill, ctx, buffer, &send_us);
+		http_stream_stats.inline_streams++;
+		http_stream_stats.read_us += esp_timer_get_time() - start - send_us;
+		failed = total < 0;
+	}
+	else {
+		stream->fill = fill;
+		stream->ctx = ctx;
+		__atomic_store_n(&stream->abort, 0, __ATOMIC_RELAXED);
+		stream->read_us = 0;
+		xQueueReset(stream->empty);
+		xQueueReset(stream->filled);
+		for (int i = 0; i < HTTP_STREAM_BUFFERS; i++) xQueueSend(stream->empty, &i, 0);
+		xTaskNotifyGive(stream->task);
+
+		// send each chunk while the reader fills the other buffer, until the end marker
+		for (;;) {
+			http_chunk_t chunk;
+			xQueueReceive(stream->filled, &chunk, portMAX_DELAY);
+			if (chunk.len <= 0) {
+				failed |= chunk.len < 0;
+				break;
+			}
+
+			if (!__atomic_load_n(&stream->abort, __ATOMIC_RELAXED)) {
+				int64_t start = esp_timer_get_time();
+				if (httpd_resp_send_chunk(req, stream->buffer[chunk.index], chunk.len) != ESP_OK) {
+					ESP_LOGE(TAG_STREAM, "Err %s httpd_resp_send_chunk", method_name);
+					__atomic_store_n(&stream->abort, 1, __ATOMIC_RELAXED);
+					failed = 1;
+				}
+				send_us += esp_timer_get_time() - start;
+				total += chunk.len;
+			}
+			xQueueSend(stream->empty, &chunk.index, portMAX_DELAY);
+		}
+
+		http_stream_stats.read_us += stream->read_us;
+		xQueueSend(HTTP_STREAM_POOL, &stream, 0);
+	}
+
+	http_stream_stats.streams++;
+	http_stream_stats.bytes += total > 0 ? total : 0;
+	http_stream_stats.send_us += send_us;
+	http_stream_stats.total_us += esp_timer_get_time() - started;
+	if (failed) http_stream_stats.aborted++;
+	return failed ? -1 : total;
+}
+
+int http_stream_statsStr(char *buffer) {
+	http_stream_stats_t *stats = &http_stream_stats;
+	return sprintf(buffer, "Stream: %ld streams (%ld inline, %ld aborted), %lld KB, read %lld ms + send %lld ms in %lld ms\n",
+			stats->streams, stats->inline_streams, stats->aborted, stats->bytes / 1024,
+			stats->read_us / 1000, stats->send_us / 1000, stats->total_us / 1000);
+}
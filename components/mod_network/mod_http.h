@@ -208,6 +208,7 @@ static esp_err_t get_data_handler(httpd_req_t *req) {
 }
 
 esp_err_t HTTP_GET_RECORDS_HANDLER(httpd_req_t *req);
+esp_err_t HTTP_POST_RECORDS_HANDLER(httpd_req_t *req);
 esp_err_t HTTP_GET_CONFIG_HANDLER(httpd_req_t *req);
 esp_err_t HTTP_SAVE_CONFIG_HANDLER(httpd_req_t *req);
 esp_err_t HTTP_SCAN_HANDLER(httpd_req_t *req);
@@ -282,6 +283,14 @@ static httpd_handle_t start_webserver(void) {
 		};
 		httpd_register_uri_handler(server, &get_records_uri);
 
+		httpd_uri_t post_records_uri = {
+			.uri	  = "/p_rec",
+			.method   = HTTP_POST,
+			.handler  = HTTP_POST_RECORDS_HANDLER,
+			.user_ctx = NULL,
+		};
+		httpd_register_uri_handler(server, &post_records_uri);
+
 		httpd_uri_t scan_uri = {
 			.uri	  = "/scan",
 			.method   = HTTP_GET,
@@ -0,0 +1,257 @@
+#include <stdint.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+
+static const char *TAG_UDP = "#UDP";
+
+// ============================================================================
+// UDP INGEST: datagrams of (uuid, record_t) tuples for high rate sensors
+// ============================================================================
+// why: an http request costs far more than a 12 bytes record - one datagram carries up to 90
+// datagram: udp_header_t + count tuples of UDP_TUPLE_SIZE bytes (ingest_tuple_t, as /p_rec), little endian
+// the sequence belongs to the sender (uuid of the first tuple): +1 per datagram
+//   same sequence again = duplicate (dropped), a jump = gap (lost datagrams counted, records kept),
+//   an older one = late (counted, records kept: the reorder window drops the samples really behind
+//   the device), 0 or far behind = sender restart
+// a datagram with count 0 asks for the stats: the reply is one line of json
+// POSIX sockets only: runs on the linux target as on the chip (tools/udp_sender.py)
+
+#define UDP_MAGIC 0x5352						// "RS"
+#define UDP_VERSION 1
+#define UDP_TUPLE_SIZE 16
+#define UDP_MAX_TUPLES 90						// 8 + 90 * 16 = 1448 B: one ethernet frame
+#define UDP_MAX_DATAGRAM (sizeof(udp_header_t) + UDP_MAX_TUPLES * UDP_TUPLE_SIZE)
+#define UDP_MAX_SOURCES 64						// senders tracked, the least recent is replaced
+#define UDP_RESTART_WINDOW 1024					// further behind than this: the sender restarted
+#define UDP_TASK_STACK 4096
+#define UDP_TASK_PRIORITY 5
+
+typedef struct __attribute__((packed)) {
+	uint16_t magic;
+	uint8_t version;
+	uint8_t count;						// tuples that follow, 0 = stats request
+	uint32_t sequence;
+} udp_header_t;
+
+typedef struct {
+	uint32_t uuid;						// 0 = free
+	uint32_t sequence;					// highest seen
+	uint32_t last_seen;					// udp_stats.datagrams when it was last seen
+} udp_source_t;
+
+typedef struct {
+	uint32_t datagrams;
+	uint32_t records;
+	uint32_t accepted;					// records taken by ingest
+	uint32_t malformed;					// bad magic / version / size
+	uint32_t duplicates;
+	uint32_t late;						// older than the highest sequence, records kept
+	uint32_t gaps;						// sequence jumps
+	uint32_t lost;						// datagrams missing in the jumps
+	uint32_t restarts;
+	uint32_t peak_rate;					// datagrams in the busiest second
+	uint32_t max_us;					// slowest datagram (parse + ingest)
+	uint64_t total_us;
+} udp_stats_t;
+
+static udp_stats_t udp_stats = {0};
+static udp_source_t UDP_SOURCES[UDP_MAX_SOURCES] = {0};
+static TaskHandle_t UDP_TASK = NULL;
+
+// records of one datagram (count tuples, ingest_tuple_t layout) - main-services.h
+int UDP_RECORDS_HANDLER(const uint8_t *tuples, int count);
+
+typedef enum {
+	UDP_SEQUENCE_NEXT = 0,
+	UDP_SEQUENCE_GAP,
+	UDP_SEQUENCE_DUPLICATE,
+	UDP_SEQUENCE_LATE,
+	UDP_SEQUENCE_RESTART,
+} udp_sequence_t;
+
+static udp_source_t* udp_find_source(uint32_t uuid) {
+	udp_source_t *free_source = NULL;
+	udp_source_t *oldest = NULL;
+
+	for (int i = 0; i < UDP_MAX_SOURCES; i++) {
+		udp_source_t *source = &UDP_SOURCES[i];
+		if (source->uuid == uuid) return source;
+		if (!source->uuid) {
+			if (!free_source) free_source = source;
+		}
+		else if (!oldest || source->last_seen < oldest->last_seen) {
+			oldest = source;
+		}
+	}
+
+	// new sender: takes a free entry, the least recent one when all are taken
+	udp_source_t *source = free_source ? free_source : oldest;
+	memset(source, 0, sizeof(*source));
+	return source;
+}
+
+//* @brief Check the sequence of a datagram from uuid against the last one of the sender
+static udp_sequence_t udp_check_sequence(uint32_t uuid, uint32_t sequence) {
+	udp_source_t *source = udp_find_source(uuid);
+	const int known = source->uuid == uuid;
+	const int32_t diff = (int32_t)(sequence - source->sequence);
+	udp_sequence_t status = UDP_SEQUENCE_NEXT;
+
+	if (!known || sequence == 0 || diff < -UDP_RESTART_WINDOW) {
+		status = known ? UDP_SEQUENCE_RESTART : UDP_SEQUENCE_NEXT;
+	}
+	else if (diff == 0) {
+		return UDP_SEQUENCE_DUPLICATE;
+	}
+	else if (diff < 0) {
+		// one of the datagrams counted lost by a jump: the highest sequence stays
+		if (udp_stats.lost) udp_stats.lost--;
+		source->last_seen = udp_stats.datagrams;
+		return UDP_SEQUENCE_LATE;
+	}
+	else if (diff > 1) {
+		status = UDP_SEQUENCE_GAP;
+		udp_stats.lost += diff - 1;
+	}
+
+	source->uuid = uuid;
+	source->sequence = sequence;
+	source->last_seen = udp_stats.datagrams;
+	return status;
+}
+
+//* @brief Parse one datagram and hand its records to ingest, returns the records accepted (-1 malformed)
+static int udp_process_datagram(const uint8_t *data, int len) {
+	udp_header_t header;
+	if (len < (int)sizeof(header)) return -1;
+	memcpy(&header, data, sizeof(header));
+
+	if (header.magic != UDP_MAGIC || header.version != UDP_VERSION ||
+		header.count > UDP_MAX_TUPLES || len != (int)(sizeof(header) + header.count * UDP_TUPLE_SIZE)
+	) {
+		return -1;
+	}
+	if (header.count == 0) return 0;
+
+	const uint8_t *tuples = data + sizeof(header);
+	uint32_t uuid;
+	memcpy(&uuid, tuples, sizeof(uuid));
+
+	switch (udp_check_sequence(uuid, header.sequence)) {
+		case UDP_SEQUENCE_DUPLICATE: udp_stats.duplicates++; return 0;
+		case UDP_SEQUENCE_LATE: udp_stats.late++; break;
+		case UDP_SEQUENCE_GAP: udp_stats.gaps++; break;
+		case UDP_SEQUENCE_RESTART: udp_stats.restarts++; break;
+		default: break;
+	}
+
+	udp_stats.records += header.count;
+	int accepted = UDP_RECORDS_HANDLER(tuples, header.count);
+	udp_stats.accepted += accepted;
+	return accepted;
+}
+
+int udp_stats_json(char *buffer, size_t size) {
+	udp_stats_t *stats = &udp_stats;
+	return snprintf(buffer, size,
+			"{\"datagrams\":%ld,\"records\":%ld,\"accepted\":%ld,\"malformed\":%ld,\"duplicates\":%ld,"
+			"\"late\":%ld,\"gaps\":%ld,\"lost\":%ld,\"restarts\":%ld,\"peak_rate\":%ld,\"max_us\":%ld,\"avg_us\":%lld}\n",
+			stats->datagrams, stats->records, stats->accepted, stats->malformed, stats->duplicates,
+			stats->late, stats->gaps, stats->lost, stats->restarts, stats->peak_rate, stats->max_us,
+			stats->datagrams ? stats->total_us / stats->datagrams : 0);
+}
+
+int udp_statsStr(char *buffer) {
+	udp_stats_t *stats = &udp_stats;
+	uint32_t avg_us = stats->datagrams ? stats->total_us / stats->datagrams : 0;
+	return sprintf(buffer, "UDP: %ld datagrams, %ld/%ld records, %ld gaps (%ld lost), %ld dup, %ld late, peak %ld/s, %ld us avg\n",
+			stats->datagrams, stats->accepted, stats->records, stats->gaps, stats->lost,
+			stats->duplicates, stats->late, stats->peak_rate, avg_us);
+}
+
+//* @brief Receive and process one datagram, returns 0 on a socket error
+static int udp_receive_one(int sock, uint8_t *buffer, int64_t *window_start, uint32_t *window_count) {
+	struct sockaddr_in from;
+	socklen_t from_len = sizeof(from);
+	int len = recvfrom(sock, buffer, UDP_MAX_DATAGRAM, 0, (struct sockaddr*)&from, &from_len);
+	if (len < 0) return 0;
+
+	int64_t start = esp_timer_get_time();
+	int result = udp_process_datagram(buffer, len);
+	uint32_t elapsed = esp_timer_get_time() - start;
+
+	if (result < 0) {
+		udp_stats.malformed++;
+		return 1;
+	}
+
+	if (len == sizeof(udp_header_t)) {
+		char json[320];
+		int json_len = udp_stats_json(json, sizeof(json));
+		sendto(sock, json, json_len, 0, (struct sockaddr*)&from, from_len);
+		return 1;
+	}
+
+	udp_stats.datagrams++;
+	udp_stats.total_us += elapsed;
+	if (elapsed > udp_stats.max_us) udp_stats.max_us = elapsed;
+
+	// datagrams per second window
+	if (start - *window_start >= 1000000) {
+		*window_start = start;
+		*window_count = 0;
+	}
+	if (++(*window_count) > udp_stats.peak_rate) udp_stats.peak_rate = *window_count;
+	return 1;
+}
+
+static void udp_listener_task(void *arg) {
+	const char method_name[] = "udp_listener_task";
+	const uint16_t port = (uintptr_t)arg;
+	static uint8_t buffer[UDP_MAX_DATAGRAM] __attribute__((aligned(4)));
+
+	int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	struct sockaddr_in addr = {
+		.sin_family = AF_INET,
+		.sin_port = htons(port),
+		.sin_addr.s_addr = htonl(INADDR_ANY),
+	};
+
+	if (sock < 0 || bind(sock, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+		ESP_LOGE(TAG_UDP, "%s BIND-FAILED port %d", method_name, port);
+		if (sock >= 0) close(sock);
+		UDP_TASK = NULL;
+		vTaskDelete(NULL);
+		return;
+	}
+
+	ESP_LOGI(TAG_UDP, "%s LISTENING port %d", method_name, port);
+	int64_t window_start = 0;
+	uint32_t window_count = 0;
+
+	while (udp_receive_one(sock, buffer, &window_start, &window_count));
+
+	ESP_LOGE(TAG_UDP, "%s RECV-FAILED", method_name);
+	close(sock);
+	UDP_TASK = NULL;
+	vTaskDelete(NULL);
+}
+
+//* @brief Start the listener task on port (0: disabled) - it lives as long as the socket works
+static void udp_listener_start(uint16_t port) {
+	if (!port || UDP_TASK) return;
+
+	if (xTaskCreate(udp_listener_task, "udp_listener", UDP_TASK_STACK,
+					(void*)(uintptr_t)port, UDP_TASK_PRIORITY, &UDP_TASK) != pdPASS) {
+		ESP_LOGE(TAG_UDP, "TASK-FAILED");
+		UDP_TASK = NULL;
+	}
+}
@@ -12,6 +12,7 @@
 #include "lwip/sys.h"
 
 #include "mod_http.h"
+#include "mod_udp.h"
 #include "mod_ntp.h"
 #include "mdns.h"
 
@@ -199,6 +200,9 @@ void wifi_poll() {
 				//# START WEB SERVER
 				web_server = start_webserver();
 
+				//# START UDP INGEST (high rate sensors)
+				udp_listener_start(CONFIG_UDP_INGEST_PORT);
+
 				//# START MDNS
 				esp_err_t err = mdns_init();
 				if (err != ESP_OK) {
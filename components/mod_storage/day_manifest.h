@@ -0,0 +1,96 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <dirent.h>
+
+// ============================================================================
+// DAY MANIFEST: in-RAM index of the day files in a device year directory
+// ============================================================================
+// one readdir of /log/<uuid>/YY replaces the stat probing of each path resolution,
+// the writer marks a day on create, deletes through http forget the manifest (reloaded on next use)
+// day bit: (month - 1) * 31 + (day - 1) - 372 bits a year, invalid dates are never set
+
+#define DAY_MANIFEST_DAYS (12 * 31)
+#define DAY_MANIFEST_BYTES ((DAY_MANIFEST_DAYS + 7) / 8)
+
+#define DAY_MANIFEST_LOADED 0x01		// the year directory was listed (directories exist)
+
+typedef struct {
+	uint8_t year;						// 2 digits year of the listing
+	uint8_t flags;
+	uint16_t day_count;					// day files in the year
+	uint8_t days[DAY_MANIFEST_BYTES];	// MMDD.bin - segmented day files
+	uint8_t legacy[DAY_MANIFEST_BYTES];	// MMDD-0.bin - legacy 4KB flat files
+} day_manifest_t;
+
+static inline int day_manifest_index(int month, int day) {
+	if (month < 1 || month > 12 || day < 1 || day > 31) return -1;
+	return (month - 1) * 31 + (day - 1);
+}
+
+static inline int day_manifest_loaded(const day_manifest_t *manifest, int year) {
+	return (manifest->flags & DAY_MANIFEST_LOADED) && manifest->year == year;
+}
+
+static inline int day_manifest_bit(const uint8_t *bits, int month, int day) {
+	int index = day_manifest_index(month, day);
+	return index >= 0 && (bits[index >> 3] & (1 << (index & 7)));
+}
+
+//* @brief Returns 1 when the segmented day file exists (the manifest must be loaded for its year)
+static inline int day_manifest_has(const day_manifest_t *manifest, int month, int day) {
+	return day_manifest_bit(manifest->days, month, day);
+}
+
+static inline int day_manifest_has_legacy(const day_manifest_t *manifest, int month, int day) {
+	return day_manifest_bit(manifest->legacy, month, day);
+}
+
+static void day_manifest_mark(uint8_t *bits, uint16_t *count, int month, int day) {
+	int index = day_manifest_index(month, day);
+	if (index < 0 || (bits[index >> 3] & (1 << (index & 7)))) return;
+
+	bits[index >> 3] |= 1 << (index & 7);
+	if (count) (*count)++;
+}
+
+//* @brief Record a created day file
+static inline void day_manifest_set(day_manifest_t *manifest, int month, int day) {
+	day_manifest_mark(manifest->days, &manifest->day_count, month, day);
+}
+
+//* @brief Drop the listing: the next lookup of the year lists the directory again
+static inline void day_manifest_forget(day_manifest_t *manifest) {
+	memset(manifest, 0, sizeof(*manifest));
+}
+
+//* @brief List the year directory dir_path once, returns 0 when it can't be opened
+// names: MMDD.bin (day file), MMDD-0.bin (first legacy file) - anything else is skipped
+
+static int day_manifest_load(day_manifest_t *manifest, const char *dir_path, int year) {
+	day_manifest_forget(manifest);
+
+	DIR *dir = opendir(dir_path);
+	if (!dir) return 0;
+
+	struct dirent *entry;
+	while ((entry = readdir(dir)) != NULL) {
+		const char *name = entry->d_name;
+		int month, day, len = 0;
+		if (sscanf(name, "%2d%2d%n", &month, &day, &len) != 2 || len != 4) continue;
+
+		// 8.3 names come back upper case without long file names
+		if (strcasecmp(name + len, ".bin") == 0) {
+			day_manifest_mark(manifest->days, &manifest->day_count, month, day);
+		}
+		else if (strcasecmp(name + len, "-0.bin") == 0) {
+			day_manifest_mark(manifest->legacy, NULL, month, day);
+		}
+	}
+	closedir(dir);
+
+	manifest->year = year;
+	manifest->flags = DAY_MANIFEST_LOADED;
+	return 1;
+}
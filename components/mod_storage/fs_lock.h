@@ -0,0 +1,190 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_timer.h"
+
+// ============================================================================
+// FS LOCK: reader-writer locks striped by device
+// ============================================================================
+// why: one FS mutex made every request wait for the storage writer, whatever the device it writes
+// a device directory maps to one of the stripes (uuid % stripes): the writer only blocks the readers
+// of its own stripe - the files outside the device directories share one more stripe,
+// FS_LOCK_ALL takes every stripe in order (no deadlock between two of them)
+// esp_http_server runs one handler at a time: readers never overlap today, the shared mode only
+// matters once they do (async handlers)
+// each stripe is the no-starve lock of 3 semaphores: a waiting writer holds the turnstile,
+// new readers queue behind it instead of keeping the room busy forever
+// FATFS locks the volume per call itself: the stripes order the multi call sequences (read a file, insert)
+
+#define FS_LOCK_STRIPES_MAX 16
+#define FS_LOCK_ALL -1
+#define FS_LOCK_FOREVER UINT32_MAX
+
+typedef enum {
+	FS_LOCK_READ = 0,
+	FS_LOCK_WRITE,
+} fs_lock_mode_t;
+
+typedef struct {
+	SemaphoreHandle_t turnstile;		// binary: every taker passes, a writer keeps it
+	SemaphoreHandle_t room;				// binary: held by the writer or by the readers as a group
+	SemaphoreHandle_t readers_mutex;	// guards readers
+	int readers;
+} fs_stripe_t;
+
+// a held lock: give it back with fs_lock_give
+typedef struct {
+	int16_t key;						// stripe, FS_LOCK_ALL
+	uint8_t mode;
+	uint8_t held;
+} fs_lock_t;
+
+// counters - atomic, read them as approximate
+typedef struct {
+	uint32_t reads;
+	uint32_t writes;
+	uint32_t contended;					// had to wait
+	uint32_t timeouts;					// gave up: "FS busy"
+	uint32_t max_wait_us;
+	uint64_t wait_us;
+} fs_lock_stats_t;
+
+static fs_stripe_t FS_STRIPES[FS_LOCK_STRIPES_MAX + 1];		// + the shared stripe
+static int FS_STRIPE_COUNT = 0;									// device stripes
+static fs_lock_stats_t fs_lock_stats = {0};
+
+//* @brief Create stripes device stripes (1 - FS_LOCK_STRIPES_MAX) and the shared one, returns 0 when out of memory
+static int fs_lock_init(int stripes) {
+	if (FS_STRIPE_COUNT) return 1;
+	if (stripes < 1) stripes = 1;
+	if (stripes > FS_LOCK_STRIPES_MAX) stripes = FS_LOCK_STRIPES_MAX;
+
+	for (int i = 0; i <= stripes; i++) {
+		fs_stripe_t *stripe = &FS_STRIPES[i];
+		stripe->turnstile = xSemaphoreCreateBinary();
+		stripe->room = xSemaphoreCreateBinary();
+		stripe->readers_mutex = xSemaphoreCreateMutex();
+		if (!stripe->turnstile || !stripe->room || !stripe->readers_mutex) return 0;
+
+		// binary semaphores start taken
+		xSemaphoreGive(stripe->turnstile);
+		xSemaphoreGive(stripe->room);
+	}
+
+	FS_STRIPE_COUNT = stripes;
+	return 1;
+}
+
+//* @brief Stripe of a device directory
+static inline int fs_lock_key_uuid(uint32_t uuid) {
+	return FS_STRIPE_COUNT ? uuid % FS_STRIPE_COUNT : 0;
+}
+
+//* @brief Stripe of the files outside the device directories
+static inline int fs_lock_key_shared() {
+	return FS_STRIPE_COUNT;
+}
+
+// ticks left until deadline (FS_LOCK_FOREVER: portMAX_DELAY)
+static TickType_t fs_lock_remaining(TickType_t deadline, uint32_t wait_ms) {
+	if (wait_ms == FS_LOCK_FOREVER) return portMAX_DELAY;
+	TickType_t now = xTaskGetTickCount();
+	return (int32_t)(deadline - now) > 0 ? deadline - now : 0;
+}
+
+static int fs_stripe_take(fs_stripe_t *stripe, fs_lock_mode_t mode, TickType_t deadline, uint32_t wait_ms) {
+	if (xSemaphoreTake(stripe->turnstile, fs_lock_remaining(deadline, wait_ms)) != pdTRUE) return 0;
+
+	if (mode == FS_LOCK_WRITE) {
+		// keep the turnstile: the readers arriving now wait for this writer
+		if (xSemaphoreTake(stripe->room, fs_lock_remaining(deadline, wait_ms)) != pdTRUE) {
+			xSemaphoreGive(stripe->turnstile);
+			return 0;
+		}
+		return 1;
+	}
+
+	xSemaphoreGive(stripe->turnstile);
+	if (xSemaphoreTake(stripe->readers_mutex, fs_lock_remaining(deadline, wait_ms)) != pdTRUE) return 0;
+
+	// the first reader takes the room for the group
+	if (stripe->readers == 0 && xSemaphoreTake(stripe->room, fs_lock_remaining(deadline, wait_ms)) != pdTRUE) {
+		xSemaphoreGive(stripe->readers_mutex);
+		return 0;
+	}
+	stripe->readers++;
+	xSemaphoreGive(stripe->readers_mutex);
+	return 1;
+}
+
+static void fs_stripe_give(fs_stripe_t *stripe, fs_lock_mode_t mode) {
+	if (mode == FS_LOCK_WRITE) {
+		xSemaphoreGive(stripe->room);
+		xSemaphoreGive(stripe->turnstile);
+		return;
+	}
+
+	// the last reader frees the room
+	xSemaphoreTake(stripe->readers_mutex, portMAX_DELAY);
+	if (--stripe->readers == 0) xSemaphoreGive(stripe->room);
+	xSemaphoreGive(stripe->readers_mutex);
+}
+
+//* @brief Lock the stripe key (FS_LOCK_ALL: every stripe) waiting up to wait_ms, returns 0 on timeout
+// without fs_lock_init (tests, no SD) the lock always succeeds
+static int fs_lock_take(fs_lock_t *lock, int key, fs_lock_mode_t mode, uint32_t wait_ms) {
+	lock->key = key;
+	lock->mode = mode;
+	lock->held = 0;
+	if (!FS_STRIPE_COUNT) return 1;
+
+	const TickType_t deadline = xTaskGetTickCount() + (wait_ms == FS_LOCK_FOREVER ? 0 : pdMS_TO_TICKS(wait_ms));
+	const int first = key == FS_LOCK_ALL ? 0 : key;
+	const int last = key == FS_LOCK_ALL ? FS_STRIPE_COUNT : key;
+	int64_t start = esp_timer_get_time();
+	int taken = first;
+
+	for (; taken <= last; taken++) {
+		if (!fs_stripe_take(&FS_STRIPES[taken], mode, deadline, wait_ms)) break;
+	}
+
+	// several readers at once: atomic counters
+	fs_lock_stats_t *stats = &fs_lock_stats;
+	uint32_t waited = esp_timer_get_time() - start;
+	__atomic_fetch_add(mode == FS_LOCK_WRITE ? &stats->writes : &stats->reads, 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&stats->wait_us, waited, __ATOMIC_RELAXED);
+	if (waited > 1000) __atomic_fetch_add(&stats->contended, 1, __ATOMIC_RELAXED);
+
+	uint32_t peak = __atomic_load_n(&stats->max_wait_us, __ATOMIC_RELAXED);
+	while (waited > peak && !__atomic_compare_exchange_n(&stats->max_wait_us, &peak, waited, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+	if (taken <= last) {
+		while (--taken >= first) fs_stripe_give(&FS_STRIPES[taken], mode);
+		__atomic_fetch_add(&stats->timeouts, 1, __ATOMIC_RELAXED);
+		return 0;
+	}
+
+	lock->held = 1;
+	return 1;
+}
+
+//* @brief Give back a lock of fs_lock_take
+static void fs_lock_give(fs_lock_t *lock) {
+	if (!lock->held) return;
+	const int first = lock->key == FS_LOCK_ALL ? 0 : lock->key;
+	const int last = lock->key == FS_LOCK_ALL ? FS_STRIPE_COUNT : lock->key;
+
+	for (int i = last; i >= first; i--) fs_stripe_give(&FS_STRIPES[i], lock->mode);
+	lock->held = 0;
+}
+
+int fs_lock_statsStr(char *buffer) {
+	fs_lock_stats_t *stats = &fs_lock_stats;
+	uint32_t takes = stats->reads + stats->writes;
+	return sprintf(buffer, "FS lock: %d stripes, %ld reads, %ld writes, %ld contended, %ld busy, wait %ld us avg / %ld us max\n",
+			FS_STRIPE_COUNT, stats->reads, stats->writes, stats->contended, stats->timeouts,
+			takes ? (uint32_t)(stats->wait_us / takes) : 0, stats->max_wait_us);
+}
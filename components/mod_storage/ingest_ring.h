@@ -0,0 +1,165 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+// ============================================================================
+// INGEST RING: bounded lock-free queue of fixed size items (Vyukov)
+// ============================================================================
+// every cell carries a sequence number: a producer claims a position with one CAS on head,
+// copies its item and publishes it by storing the sequence - no lock, no task ever waits
+// any number of producers, the consumer side is safe for several too (drop oldest pops from producers)
+// full ring: the push is rejected, or with INGEST_RING_DROP_OLDEST the oldest item makes room
+// positions are free running uint32_t: capacity is a power of 2 (wraps cleanly)
+// pure C, no ESP dependencies: __atomic builtins (gcc / clang), the caller owns the notification
+
+typedef enum {
+	INGEST_RING_REJECT = 0,				// full: the new item is refused (the sender can retry)
+	INGEST_RING_DROP_OLDEST,			// full: the oldest item is discarded (latest data wins)
+} ingest_ring_policy_t;
+
+#define INGEST_RING_DROP_RETRIES 4		// drop + push attempts before giving up on a contended ring
+
+typedef struct {
+	uint8_t *cells;						// capacity cells of stride bytes: uint32_t sequence + item
+	uint32_t mask;						// capacity - 1
+	uint16_t item_size;
+	uint16_t stride;
+	uint8_t policy;
+	uint32_t head;						// next position to push (producers)
+	uint32_t tail;						// next position to pop (consumer)
+
+	// counters - atomic, read them as approximate
+	uint32_t pushed;
+	uint32_t popped;
+	uint32_t dropped;					// oldest items discarded to make room
+	uint32_t rejected;					// items refused on a full ring
+	uint32_t high_water;				// most items waiting
+} ingest_ring_t;
+
+static inline uint32_t* ingest_ring_sequence(const ingest_ring_t *ring, uint32_t pos) {
+	return (uint32_t*)(ring->cells + (size_t)(pos & ring->mask) * ring->stride);
+}
+
+static inline uint32_t ingest_ring_capacity(const ingest_ring_t *ring) {
+	return ring->cells ? ring->mask + 1 : 0;
+}
+
+//* @brief Items waiting in the ring (approximate while producers run)
+static inline uint32_t ingest_ring_depth(const ingest_ring_t *ring) {
+	uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+	uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+	return (int32_t)(head - tail) > 0 ? head - tail : 0;
+}
+
+//* @brief Allocate a ring of capacity items (rounded up to a power of 2), returns 0 when out of memory
+static int ingest_ring_create(ingest_ring_t *ring, uint32_t capacity, size_t item_size, ingest_ring_policy_t policy) {
+	memset(ring, 0, sizeof(*ring));
+
+	uint32_t size = 2;
+	while (size < capacity && size < 0x40000000) size <<= 1;
+
+	const size_t stride = (sizeof(uint32_t) + item_size + 3) & ~(size_t)3;
+	ring->cells = malloc(size * stride);
+	if (!ring->cells) return 0;
+
+	ring->mask = size - 1;
+	ring->item_size = item_size;
+	ring->stride = stride;
+	ring->policy = policy;
+
+	// cell i expects the producer of position i
+	for (uint32_t i = 0; i < size; i++) {
+		*ingest_ring_sequence(ring, i) = i;
+	}
+	return 1;
+}
+
+static void ingest_ring_free(ingest_ring_t *ring) {
+	free(ring->cells);
+	memset(ring, 0, sizeof(*ring));
+}
+
+//* @brief Pop the oldest item into out (NULL discards it), returns 0 when the ring is empty
+static int ingest_ring_pop(ingest_ring_t *ring, void *out) {
+	uint32_t pos = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+
+	for (;;) {
+		uint32_t *sequence = ingest_ring_sequence(ring, pos);
+		int32_t diff = (int32_t)(__atomic_load_n(sequence, __ATOMIC_ACQUIRE) - (pos + 1));
+
+		if (diff == 0) {
+			if (__atomic_compare_exchange_n(&ring->tail, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+				if (out) memcpy(out, sequence + 1, ring->item_size);
+				// free the cell for the producer one lap ahead
+				__atomic_store_n(sequence, pos + ring->mask + 1, __ATOMIC_RELEASE);
+				__atomic_fetch_add(&ring->popped, 1, __ATOMIC_RELAXED);
+				return 1;
+			}
+			// pos reloaded by the failed CAS
+		}
+		else if (diff < 0) {
+			return 0;			// not published yet: empty
+		}
+		else {
+			pos = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+		}
+	}
+}
+
+static int ingest_ring_try_push(ingest_ring_t *ring, const void *item) {
+	uint32_t pos = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+
+	for (;;) {
+		uint32_t *sequence = ingest_ring_sequence(ring, pos);
+		int32_t diff = (int32_t)(__atomic_load_n(sequence, __ATOMIC_ACQUIRE) - pos);
+
+		if (diff == 0) {
+			if (__atomic_compare_exchange_n(&ring->head, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+				memcpy(sequence + 1, item, ring->item_size);
+				__atomic_store_n(sequence, pos + 1, __ATOMIC_RELEASE);
+				return 1;
+			}
+		}
+		else if (diff < 0) {
+			return 0;			// the consumer is a lap behind: full
+		}
+		else {
+			pos = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+		}
+	}
+}
+
+//* @brief Push one item, never blocks - returns 0 when the item was refused
+// INGEST_RING_DROP_OLDEST: a full ring discards its oldest item instead (counted in dropped)
+
+static int ingest_ring_push(ingest_ring_t *ring, const void *item) {
+	int pushed = ingest_ring_try_push(ring, item);
+
+	for (int retry = 0; !pushed && ring->policy == INGEST_RING_DROP_OLDEST && retry < INGEST_RING_DROP_RETRIES; retry++) {
+		if (ingest_ring_pop(ring, NULL)) {
+			__atomic_fetch_sub(&ring->popped, 1, __ATOMIC_RELAXED);
+			__atomic_fetch_add(&ring->dropped, 1, __ATOMIC_RELAXED);
+		}
+		pushed = ingest_ring_try_push(ring, item);
+	}
+
+	if (!pushed) {
+		__atomic_fetch_add(&ring->rejected, 1, __ATOMIC_RELAXED);
+		return 0;
+	}
+
+	__atomic_fetch_add(&ring->pushed, 1, __ATOMIC_RELAXED);
+	uint32_t depth = ingest_ring_depth(ring);
+	uint32_t peak = __atomic_load_n(&ring->high_water, __ATOMIC_RELAXED);
+	while (depth > peak && !__atomic_compare_exchange_n(&ring->high_water, &peak, depth, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+	return 1;
+}
+
+//* @brief Pop up to max items into out (contiguous), returns the items popped
+static int ingest_ring_pop_batch(ingest_ring_t *ring, void *out, int max) {
+	uint8_t *ptr = (uint8_t*)out;
+	int n = 0;
+	while (n < max && ingest_ring_pop(ring, ptr + (size_t)n * ring->item_size)) n++;
+	return n;
+}
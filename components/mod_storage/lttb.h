@@ -0,0 +1,189 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+// ============================================================================
+// LTTB: streaming Largest-Triangle-Three-Buckets downsampling of a series range
+// ============================================================================
+// series layout: uint32_t timestamp followed by int16_t values (as the series codec)
+// [t_start, t_end] is cut in points - 2 buckets of equal time, the first and last series are kept,
+// each bucket keeps the series with the largest triangle between the last kept one and the
+// mean of the next bucket: peaks survive where every k-th sample drops them
+// only two buckets are held: the one to pick from and the next one filling up (LTTB_BUCKET_MAX each)
+// integer math (no float): areas are scaled by the series count of the next bucket
+// pure C, no ESP dependencies: emit() gets the kept series in time order
+
+#define LTTB_BUCKET_MAX 256						// series held per bucket, lttb_min_points keeps them under
+#define LTTB_SERIES_MAX 12						// record_t: the means, not the envelopes
+
+typedef int (*lttb_emit_fn)(void *ctx, const uint8_t *series);
+
+typedef struct {
+	uint32_t t_start;
+	uint32_t width;							// seconds per bucket
+	uint16_t series_size;
+	uint8_t value_index;					// value driving the selection (0: value1)
+	lttb_emit_fn emit;
+	void *ctx;
+
+	int started;
+	uint8_t anchor[LTTB_SERIES_MAX];		// last kept series (A)
+	uint8_t last[LTTB_SERIES_MAX];			// last series pushed: the final point
+	int has_last;
+
+	uint32_t held_bucket;
+	int held_count;
+	uint32_t next_bucket;
+	int next_count;
+	int64_t next_sum_x;						// timestamps - t_start
+	int64_t next_sum_y;
+
+	uint32_t pushed;
+	uint32_t emitted;
+	uint32_t overflow;						// series over LTTB_BUCKET_MAX in a bucket (not candidates)
+	int aborted;							// emit() failed
+
+	// buffers last: lttb_init only clears what is above
+	uint8_t held[LTTB_BUCKET_MAX * LTTB_SERIES_MAX];		// bucket to pick from (B candidates)
+	uint8_t next[LTTB_BUCKET_MAX * LTTB_SERIES_MAX];		// filling bucket: its mean is C
+} lttb_t;
+
+static inline uint32_t lttb_time(const uint8_t *series) {
+	uint32_t timestamp;
+	memcpy(&timestamp, series, sizeof(timestamp));
+	return timestamp;
+}
+
+static inline int32_t lttb_value(const lttb_t *lttb, const uint8_t *series) {
+	int16_t value;
+	memcpy(&value, series + sizeof(uint32_t) + lttb->value_index * sizeof(int16_t), sizeof(value));
+	return value;
+}
+
+//* @brief Fewest points that keep every bucket under LTTB_BUCKET_MAX for series resolution seconds apart
+static inline int lttb_min_points(uint32_t t_start, uint32_t t_end, uint32_t resolution) {
+	uint64_t series = (uint64_t)(t_end - t_start) / (resolution ? resolution : 1) + 1;
+	return (int)((series + LTTB_BUCKET_MAX - 1) / LTTB_BUCKET_MAX) + 2;
+}
+
+//* @brief Start a downsample of [t_start, t_end] to points series (3 at least)
+static void lttb_init(
+	lttb_t *lttb, uint32_t t_start, uint32_t t_end, int points,
+	size_t series_size, int value_index, lttb_emit_fn emit, void *ctx
+) {
+	memset(lttb, 0, offsetof(lttb_t, held));
+	if (points < 3) points = 3;
+	if (series_size > LTTB_SERIES_MAX) series_size = LTTB_SERIES_MAX;
+
+	const uint32_t span = t_end - t_start + 1;
+	lttb->t_start = t_start;
+	lttb->width = (span + points - 3) / (points - 2);		// ceil: points - 2 buckets cover the span
+	if (!lttb->width) lttb->width = 1;
+	lttb->series_size = series_size;
+	lttb->value_index = value_index;
+	lttb->emit = emit;
+	lttb->ctx = ctx;
+}
+
+static void lttb_emit(lttb_t *lttb, const uint8_t *series) {
+	if (lttb->aborted) return;
+	if (!lttb->emit(lttb->ctx, series)) lttb->aborted = 1;
+	lttb->emitted++;
+}
+
+// keep the held candidate with the largest triangle (anchor, candidate, C), C = sum / count
+// exclude_last: the final point is kept on its own, it can't be a candidate
+static void lttb_pick(lttb_t *lttb, int64_t sum_x, int64_t sum_y, int count, int exclude_last) {
+	const int candidates = lttb->held_count - (exclude_last ? 1 : 0);
+	if (candidates <= 0) return;
+
+	const int64_t ax = (int64_t)(lttb_time(lttb->anchor) - lttb->t_start);
+	const int64_t ay = lttb_value(lttb, lttb->anchor);
+	const size_t size = lttb->series_size;
+	int64_t best_area = -1;
+	int best = 0;
+
+	for (int i = 0; i < candidates; i++) {
+		const uint8_t *series = lttb->held + i * size;
+		const int64_t bx = (int64_t)(lttb_time(series) - lttb->t_start);
+		const int64_t by = lttb_value(lttb, series);
+
+		// twice the area, times count: (A - C) x (B - A) with C = S / n
+		int64_t area = (ax * count - sum_x) * (by - ay) - (ax - bx) * (sum_y - ay * count);
+		if (area < 0) area = -area;
+		if (area > best_area) {
+			best_area = area;
+			best = i;
+		}
+	}
+
+	memcpy(lttb->anchor, lttb->held + best * size, size);
+	lttb_emit(lttb, lttb->anchor);
+}
+
+// the next bucket is complete: pick from the held one, the next one becomes the held one
+static void lttb_shift(lttb_t *lttb) {
+	if (lttb->held_count && lttb->next_count) {
+		lttb_pick(lttb, lttb->next_sum_x, lttb->next_sum_y, lttb->next_count, 0);
+	}
+
+	memcpy(lttb->held, lttb->next, lttb->next_count * lttb->series_size);
+	lttb->held_count = lttb->next_count;
+	lttb->held_bucket = lttb->next_bucket;
+	lttb->next_count = 0;
+	lttb->next_sum_x = 0;
+	lttb->next_sum_y = 0;
+}
+
+//* @brief Push count series in time order (series before t_start are skipped), returns 0 once emit failed
+static int lttb_push(lttb_t *lttb, const void *series_buffer, int count) {
+	const uint8_t *ptr = (const uint8_t*)series_buffer;
+	const size_t size = lttb->series_size;
+
+	for (int i = 0; i < count && !lttb->aborted; i++) {
+		const uint8_t *series = ptr + i * size;
+		const uint32_t timestamp = lttb_time(series);
+		if (timestamp < lttb->t_start) continue;
+		lttb->pushed++;
+
+		memcpy(lttb->last, series, size);
+		lttb->has_last = 1;
+
+		// the first series is kept as is
+		if (!lttb->started) {
+			lttb->started = 1;
+			memcpy(lttb->anchor, series, size);
+			lttb_emit(lttb, series);
+			continue;
+		}
+
+		const uint32_t bucket = (timestamp - lttb->t_start) / lttb->width;
+		if (lttb->next_count && bucket != lttb->next_bucket) lttb_shift(lttb);
+
+		if (lttb->next_count >= LTTB_BUCKET_MAX) {
+			lttb->overflow++;
+			continue;
+		}
+		memcpy(lttb->next + lttb->next_count * size, series, size);
+		lttb->next_sum_x += timestamp - lttb->t_start;
+		lttb->next_sum_y += lttb_value(lttb, series);
+		lttb->next_bucket = bucket;
+		lttb->next_count++;
+	}
+	return !lttb->aborted;
+}
+
+//* @brief Emit the last buckets and the final series, returns the series emitted
+static int lttb_finish(lttb_t *lttb) {
+	if (!lttb->started) return 0;
+
+	if (lttb->next_count) lttb_shift(lttb);
+
+	// the last bucket picks against the final series, which is kept too
+	if (lttb->held_count) {
+		const int64_t cx = (int64_t)(lttb_time(lttb->last) - lttb->t_start);
+		lttb_pick(lttb, cx, lttb_value(lttb, lttb->last), 1, 1);
+		lttb_emit(lttb, lttb->last);
+	}
+	return lttb->emitted;
+}
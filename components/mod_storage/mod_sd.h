@@ -10,9 +10,18 @@
 
 #include <time.h>
 #include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
 
 #include "../lib_sd_log/lib_sd_log.h"
 #include "series_file.h"
+#include "uuid_index.h"
+#include "slab_pool.h"
+#include "day_manifest.h"
+#include "ingest_ring.h"
+#include "fs_lock.h"
 
 #define FILE_PATH_LEN 64
 
@@ -104,18 +113,20 @@ void sd_test(void) {
 
 
 //###################################################
-#define ACTIVE_RECORDS_COUNT 10
 #define RECORD_BUFFER_LEN 300					// 300 seconds of 12 bytes
-#define RECORD_MAX_FILE_COUNT 20
 #define SECONDS_PER_HOUR 3600
 
 // #define AGGREGATE_INTERVAL_SEC 300			// 5 minutes
 #define AGGREGATE_INTERVAL_SEC 300				// 5 minutes
 #define AGGREGATE_SAMPLE_COUNT 5
+#define AGGREGATE_BUCKET_SEC (AGGREGATE_INTERVAL_SEC / AGGREGATE_SAMPLE_COUNT)	// 60 seconds
 #define AGGREGATE_RECORD_COUNT 60				// 60 records 1 minute each
-#define AGGREGATE_CACHE_COUNT 5
+
+#define REORDER_WINDOW_SEC 5					// a sample waits this long for the older ones still in flight
+#define REORDER_SLOTS 8							// samples held per device: a full window releases its oldest
 
 #define USE_SD_STORAGE
+#define USE_COMPRESSED_SERIES					// delta/varint encoded day files
 typedef struct {
 	uint32_t timestamp;
 	int16_t value1;
@@ -124,21 +135,101 @@ typedef struct {
 	int16_t value4;
 } record_t;
 
+// aggregate record: the mean (record_t layout) + the envelope of the samples behind it
+// count: seconds of a 1 minute record, 1 minute records of a rollup
+// day and rollup files hold envelopes - files written before keep record_t (series_size)
+typedef struct __attribute__((packed)) {
+	uint32_t timestamp;
+	int16_t value1;
+	int16_t value2;
+	int16_t value3;
+	int16_t value4;
+	int16_t min_values[4];
+	int16_t max_values[4];
+	uint16_t count;
+} envelope_t;						// 30 bytes
+
+//* @brief Project envelopes onto their means in place: the buffer then holds count record_t
+static void envelope_to_records(void *buffer, int count) {
+	uint8_t *ptr = buffer;
+	for (int i = 0; i < count; i++) {
+		memmove(ptr + i * sizeof(record_t), ptr + i * sizeof(envelope_t), sizeof(record_t));
+	}
+}
+
+//* @brief Widen count record_t to envelopes in place (min = max = mean, count 0: unknown)
+// the buffer must hold count envelopes
+static void records_to_envelopes(void *buffer, int count) {
+	uint8_t *ptr = buffer;
+	for (int i = count - 1; i >= 0; i--) {
+		record_t record;
+		memcpy(&record, ptr + i * sizeof(record_t), sizeof(record_t));
+
+		envelope_t envelope = {
+			.timestamp = record.timestamp,
+			.value1 = record.value1, .value2 = record.value2,
+			.value3 = record.value3, .value4 = record.value4,
+			.min_values = {record.value1, record.value2, record.value3, record.value4},
+			.max_values = {record.value1, record.value2, record.value3, record.value4},
+		};
+		memcpy(ptr + i * sizeof(envelope_t), &envelope, sizeof(envelope_t));
+	}
+}
+
+//# Rollup pyramid: 1 minute -> 10 minutes -> hourly -> daily
+#define ROLLUP_LEVEL_COUNT 3
+#define ROLLUP_DAILY_CAPACITY 730				// 2 years of daily records
+
+typedef enum {
+	ROLLUP_10MIN = 0,
+	ROLLUP_HOURLY,
+	ROLLUP_DAILY,
+} rollup_level_t;
+
+static const uint32_t ROLLUP_PERIOD_SEC[ROLLUP_LEVEL_COUNT] = {600, 3600, 86400};
+
+// open bucket of a level: sums of the 1 minute records
+typedef struct {
+	uint32_t bucket;				// local time / period
+	uint16_t count;					// 1 minute records in the bucket
+	int32_t sum_values[4];
+	int16_t min_values[4];
+	int16_t max_values[4];
+} rollup_t;
+
+// running sums of one output sample: AGGREGATE_BUCKET_SEC of the seconds records
+typedef struct {
+	uint32_t sum_offsets;			// timestamps - last_aggregate_sec
+	uint16_t count;
+	int32_t sum_values[4];
+	int16_t min_values[4];
+	int16_t max_values[4];
+} aggregate_bucket_t;
+
+// samples of a device not released to sec_records yet, sorted by timestamp
+typedef struct {
+	uint32_t newest;				// latest timestamp seen
+	uint8_t count;
+	record_t pending[REORDER_SLOTS];
+} reorder_window_t;
+
 typedef struct {
 	uint32_t uuid;
 	uint32_t config;
 	uint32_t last_aggregate_sec;	// track when the last aggregate happened
-	uint32_t last_timestamp;		// last timestamp recorded
+	uint32_t last_timestamp;		// last timestamp recorded (released by the reorder window)
 	file_header_t last_header;
+	reorder_window_t reorder;
+	day_manifest_t manifest;		// day files of the current year, replaces the path probing
 
-	uint8_t file_index;				// the file index for aggregated data
-	uint8_t curr_year;
 	uint8_t curr_month;
 	uint8_t curr_day;
 
 	uint16_t last_aggregate_count;
 	uint16_t record_idx;
 	record_t sec_records[RECORD_BUFFER_LEN];		// 300 seconds
+	aggregate_bucket_t buckets[AGGREGATE_SAMPLE_COUNT];
+	rollup_t rollups[ROLLUP_LEVEL_COUNT];
 } active_records_t;
 
 typedef struct {
@@ -152,54 +243,196 @@ typedef struct {
 	uint32_t start_timestamp;
 	uint32_t last_timestamp;
 	uint32_t circular_index;
+	uint32_t last_access;			// cache_clock of the last /g_rec request
+	uint16_t hits;					// /g_rec requests served from the cache
+	uint16_t misses;				// /g_rec requests that found it empty
+	uint32_t generation;			// cache_generation of the last change: the /g_rec ETag
 	record_t min_records[AGGREGATE_RECORD_COUNT];		// 60 minutes
 } aggregate_cache_t;
 
-static device_cache_t DEVICE_CACHE[ACTIVE_RECORDS_COUNT] = {0};
-static active_records_t ACTIVE_RECORDS[ACTIVE_RECORDS_COUNT] = {0};
-static uint32_t ACTIVE_UUIDS[ACTIVE_RECORDS_COUNT] = {0};
-static aggregate_cache_t AGGREGATE_CACHE[AGGREGATE_CACHE_COUNT] = {0};
-static uint32_t AGGREGATE_CACHE_UUIDS[AGGREGATE_CACHE_COUNT] = {0};
+typedef struct {
+	uint32_t hits;
+	uint32_t misses;				// no cache or an empty one
+	uint32_t admits;				// caches loaded for a /g_rec miss
+	uint32_t evictions;
+} cache_stats_t;
+
+//# Device stores: slots from the uuid indexes (O(1) lookups, a deleted device's slot is reused)
+// the records / caches live in slab pools sized from a RAM budget at boot (device_pool_init)
+static slab_pool_t ACTIVE_POOL = {0};			// active_records_t ~4.1KB each
+static slab_pool_t AGGREGATE_POOL = {0};		// aggregate_cache_t ~750B each
+static device_cache_t *DEVICE_CACHE = NULL;		// one per active slot
+
+static uuid_index_t ACTIVE_INDEX = {0};
+static uuid_index_t DEVICE_INDEX = {0};
+static uuid_index_t AGGREGATE_INDEX = {0};
+static cache_stats_t cache_stats = {0};
+SemaphoreHandle_t INGEST_MUTEX = NULL;			// device stores lock: device_stores_lock
+
+//* @brief Lock the device stores: the uuid indexes, the pools, the hourly caches and the active records
+// every change takes it - the aggregator (or inline ingest), the storage writer, the registry
+// recursive: a storage job run inline (no writer task) takes it again from the aggregator
+// hold it for memory work only, SD reads and writes run outside of it
+static inline void device_stores_lock() {
+	if (INGEST_MUTEX) xSemaphoreTakeRecursive(INGEST_MUTEX, portMAX_DELAY);
+}
+
+static inline void device_stores_unlock() {
+	if (INGEST_MUTEX) xSemaphoreGiveRecursive(INGEST_MUTEX);
+}
 
 static int find_uuid_index(uint32_t uuid) {
-	for (int i = 0; i < ACTIVE_RECORDS_COUNT; i++) {
-		if (ACTIVE_UUIDS[i] == uuid) return i;
-	}
-	return -1;
+	return uuid_index_find(&ACTIVE_INDEX, uuid);
 }
 
 static active_records_t *find_records_store(uint32_t uuid) {
-    for (int i = 0; i < ACTIVE_RECORDS_COUNT; i++) {
-        if (ACTIVE_UUIDS[i] == uuid) return &ACTIVE_RECORDS[i];
-    }
-    return NULL;
+	return slab_pool_get(&ACTIVE_POOL, uuid_index_find(&ACTIVE_INDEX, uuid));
 }
 
 static aggregate_cache_t *find_aggregate_cache(uint32_t uuid) {
-	for (int i = 0; i < AGGREGATE_CACHE_COUNT; i++) {
-		if (AGGREGATE_CACHE_UUIDS[i] == uuid) return &AGGREGATE_CACHE[i];
+	return slab_pool_get(&AGGREGATE_POOL, uuid_index_find(&AGGREGATE_INDEX, uuid));
+}
+
+// what a /g_rec request reads from the active records of a device
+typedef struct {
+	uint32_t last_timestamp;
+	uint16_t record_idx;
+	day_manifest_t manifest;
+} device_records_view_t;
+
+//* @brief Copy the /g_rec view of a device, returns 0 when the uuid isn't registered
+// sec_records (NULL: skipped) gets the 300 seconds buffer - copied under the device stores lock:
+// the aggregator writes them meanwhile and the registry may hand the slot to another uuid
+int device_records_read(uint32_t uuid, device_records_view_t *view, record_t *sec_records) {
+	device_stores_lock();
+	active_records_t *active = find_records_store(uuid);
+	if (active) {
+		view->last_timestamp = active->last_timestamp;
+		view->record_idx = active->record_idx;
+		view->manifest = active->manifest;
+		if (sec_records) memcpy(sec_records, active->sec_records, sizeof(active->sec_records));
 	}
-	return NULL;
+	device_stores_unlock();
+	return active != NULL;
 }
 
-static void cache_device(uint32_t uuid, uint32_t time_ref) {
-	for (int i = 0; i < ACTIVE_RECORDS_COUNT; i++) {
-		device_cache_t *target = &DEVICE_CACHE[i];
+//* @brief Returns the active records of the slot, NULL when the slot is free (iterate 0..ACTIVE_POOL.capacity)
+static active_records_t *active_records_at(int slot) {
+	active_records_t *active = slab_pool_get(&ACTIVE_POOL, slot);
+	return active && active->uuid ? active : NULL;
+}
 
-		if (target->uuid == uuid) {
-			// Found existing UUID
-			target->timestamp = time_ref;
-			break;  // Done!
+//* @brief Forget the day manifests under path: /log/<uuid>/... or a parent of /log (every device)
+// call after deleting / renaming entries, the writer lists the directory again on its next insert
+void device_manifest_forget(const char *path) {
+	const char prefix[] = SD_POINT"/log/";
+	const size_t prefix_len = sizeof(prefix) - 1;
+	const size_t path_len = strlen(path);
+
+	device_stores_lock();
+	if (path_len >= prefix_len + 8 && strncmp(path, prefix, prefix_len) == 0) {
+		active_records_t *active = find_records_store(hex_to_uint32_unrolled(path + prefix_len));
+		if (active) day_manifest_forget(&active->manifest);
+	}
+	else if (strncmp(prefix, path, path_len) == 0) {
+		for (int slot = 0; slot < ACTIVE_POOL.capacity; slot++) {
+			active_records_t *active = active_records_at(slot);
+			if (active) day_manifest_forget(&active->manifest);
 		}
+	}
+	device_stores_unlock();
+}
 
-		//! Assumption: First empty slot, the rest are uuid = 0
-		// UUID is new - add to empty slot and break loop
-		if (target->uuid == 0) {
-			target->uuid = uuid;
-			target->timestamp = time_ref;
-			break;
-		}
+//* @brief FS lock stripe of path: its device, the shared stripe, FS_LOCK_ALL for a parent of /log
+int fs_lock_key_path(const char *path) {
+	const char prefix[] = SD_POINT"/log/";
+	const size_t prefix_len = sizeof(prefix) - 1;
+	const size_t path_len = strlen(path);
+
+	if (path_len >= prefix_len + 8 && strncmp(path, prefix, prefix_len) == 0) {
+		return fs_lock_key_uuid(hex_to_uint32_unrolled(path + prefix_len));
+	}
+	return strncmp(prefix, path, path_len) == 0 ? FS_LOCK_ALL : fs_lock_key_shared();
+}
+
+static void cache_device(uint32_t uuid, uint32_t time_ref) {
+	// new UUID takes a free slot, ignored when all slots are taken
+	int slot = uuid_index_acquire(&DEVICE_INDEX, uuid, NULL);
+	if (slot < 0) return;
+
+	device_cache_t *target = &DEVICE_CACHE[slot];
+	target->uuid = uuid;
+	target->timestamp = time_ref;
+}
+
+//* @brief Returns the active records of the uuid - a new uuid takes a free slot, NULL when full
+static active_records_t *register_records_store(uint32_t uuid) {
+	int created;
+	int slot = uuid_index_acquire(&ACTIVE_INDEX, uuid, &created);
+	if (slot < 0) return NULL;
+
+	if (!created) return slab_pool_get(&ACTIVE_POOL, slot);
+
+	active_records_t *active = slab_pool_take(&ACTIVE_POOL, slot);
+	if (!active) {
+		uuid_index_release(&ACTIVE_INDEX, uuid);		// out of memory
+		return NULL;
+	}
+	active->uuid = uuid;
+	return active;
+}
+
+//* @brief Drop the device from every store - the slots go back to the free stacks
+static void remove_device(uint32_t uuid) {
+	int slot = uuid_index_release(&ACTIVE_INDEX, uuid);
+	if (slot >= 0) slab_pool_put(&ACTIVE_POOL, slot);
+
+	slot = uuid_index_release(&AGGREGATE_INDEX, uuid);
+	if (slot >= 0) slab_pool_put(&AGGREGATE_POOL, slot);
+
+	slot = uuid_index_release(&DEVICE_INDEX, uuid);
+	if (slot >= 0) memset(&DEVICE_CACHE[slot], 0, sizeof(DEVICE_CACHE[0]));
+}
+
+//* @brief Size the device stores from RAM budgets (bytes) - call once at boot, before sd_load_config
+// only the slot tables are allocated here, records / caches are allocated as devices register
+
+// cache_heap_percent: the hourly caches may take this share of the free heap when it's above
+// cache_budget (0: fixed budget) - never more caches than devices, slabs are still lazy
+esp_err_t device_pool_init(size_t records_budget, size_t cache_budget, int cache_heap_percent) {
+	const char method_name[] = "device_pool_init";
+
+	int devices = slab_pool_init(&ACTIVE_POOL, sizeof(active_records_t), records_budget, UUID_INDEX_MAX_SLOTS);
+
+	size_t heap_budget = heap_caps_get_free_size(slab_pool_caps()) / 100 * cache_heap_percent;
+	if (heap_budget > cache_budget) cache_budget = heap_budget;
+	int caches = slab_pool_init(&AGGREGATE_POOL, sizeof(aggregate_cache_t), cache_budget,
+								devices ? devices : 1);
+	DEVICE_CACHE = calloc(devices ? devices : 1, sizeof(device_cache_t));
+
+	if (!devices || !DEVICE_CACHE ||
+		!uuid_index_create(&ACTIVE_INDEX, devices) ||
+		!uuid_index_create(&DEVICE_INDEX, devices) ||
+		!uuid_index_create(&AGGREGATE_INDEX, caches)
+	) {
+		ESP_LOGE(TAG_SF, "%s POOL-FAILED", method_name);
+		printf("- Budget: %d B records, %d B caches\n", records_budget, cache_budget);
+		return ESP_FAIL;
 	}
+
+	if (!INGEST_MUTEX) INGEST_MUTEX = xSemaphoreCreateRecursiveMutex();
+
+	ESP_LOGW(TAG_SF, "%s POOL-READY", method_name);
+	printf("- Devices: %d x %d B, Caches: %d x %d B (%s)\n",
+			devices, sizeof(active_records_t), caches, sizeof(aggregate_cache_t),
+			slab_pool_is_psram(&ACTIVE_POOL) ? "PSRAM" : "internal");
+	return ESP_OK;
+}
+
+int device_pool_statsStr(char *buffer) {
+	int pos = slab_pool_statsStr("Device", &ACTIVE_POOL, buffer);
+	pos += slab_pool_statsStr("Cache", &AGGREGATE_POOL, buffer + pos);
+	return pos;
 }
 
 static void test_print_last2_records(record_t *records) {
@@ -209,150 +442,175 @@ static void test_print_last2_records(record_t *records) {
 	}
 }
 
-static void aggregate_records(
-	active_records_t *active, record_t *rec_to_write, int sample_count
+//* @brief Close the running buckets into sample_count envelopes (AGGREGATE_SAMPLE_COUNT at most)
+// constant time: the sums and extremes are updated as each second arrives (reload_aggregate_specs)
+// empty buckets (no seconds in the minute) are skipped, returns the records written
+
+static int aggregate_records(
+	active_records_t *active, envelope_t *rec_to_write, int sample_count
 ) {
 	// empty records
 	memset(rec_to_write, 0, sizeof(rec_to_write[0]) * sample_count);
+	if (sample_count > AGGREGATE_SAMPLE_COUNT) sample_count = AGGREGATE_SAMPLE_COUNT;
+	int written = 0;
+
+	for (int i = 0; i < sample_count; i++) {
+		const aggregate_bucket_t *bucket = &active->buckets[i];
+		if (!bucket->count) continue;
+
+		envelope_t *rec = &rec_to_write[written++];
+		rec->timestamp = active->last_aggregate_sec + bucket->sum_offsets / bucket->count;
+		rec->value1 = bucket->sum_values[0] / bucket->count;
+		rec->value2 = bucket->sum_values[1] / bucket->count;
+		rec->value3 = bucket->sum_values[2] / bucket->count;
+		rec->value4 = bucket->sum_values[3] / bucket->count;
+		memcpy(rec->min_values, bucket->min_values, sizeof(rec->min_values));
+		memcpy(rec->max_values, bucket->max_values, sizeof(rec->max_values));
+		rec->count = bucket->count;
+	}
+	return written;
+}
 
-	// ESP_LOGE(TAG_SF, "Saving Records");
-	// for (int i = 0; i < active->last_aggregate_count; i++) {
-	// 	record_t *rec = &active->records[i];
-	// 	printf("[%d] %ld, %d\n", i, rec->timestamp, rec->value1);
-	// }
+// legacy 4KB flat files: <uuid>/YY/MMDD-n.bin
+static void touch_series_filePath(
+	char *file_path, uint32_t uuid, int year, int month, int day, int file_idx
+) {
+	snprintf(file_path, FILE_PATH_LEN, SD_POINT"/log/%08lX/%02d/%02d%02d-%d.bin",
+			uuid, year, month, day, file_idx);
+}
 
-	// aggregate the records from the current record_idx backward by the aggregated count
-	// start_idx + aggregate_count = current record_idx
-	const int total = active->last_aggregate_count;
-	const int records_per_sample = total / sample_count;
-	const int extra = total % sample_count;
-
-	// start index wrap-around
-	int start_idx = active->record_idx - total;
-	if (start_idx < 0) start_idx += RECORD_BUFFER_LEN;
-
-	uint64_t sum_timestamp = 0, sum_value1 = 0, sum_value2 = 0, sum_value3 = 0, sum_value4 = 0;
-	int count = 0, sample_idx = 0;
-
-	// Distribute extra samples: If there are 8 records over 5 sample_count
-	// distribute the extra 3 records accross the first 3 samples
-	int active_sample_size = records_per_sample;
-	if (sample_idx < extra) active_sample_size++;
-
-	for (int i = 0; i < total; i++) {
-		int idx = start_idx + i;
-		// handle wrap-around
-		if (idx >= RECORD_BUFFER_LEN) idx -= RECORD_BUFFER_LEN;
-
-		sum_timestamp += active->sec_records[idx].timestamp;
-		sum_value1 += active->sec_records[idx].value1;
-		sum_value2 += active->sec_records[idx].value2;
-		sum_value3 += active->sec_records[idx].value3;
-		count++;
+// segmented day files: <uuid>/YY/MMDD.bin
+static void touch_day_filePath(
+	char *file_path, uint32_t uuid, int year, int month, int day
+) {
+	snprintf(file_path, FILE_PATH_LEN, SD_POINT"/log/%08lX/%02d/%02d%02d.bin",
+			uuid, year, month, day);
+}
 
-		if (count >= active_sample_size) {
-			rec_to_write[sample_idx].timestamp = sum_timestamp / count;
-			rec_to_write[sample_idx].value1 = sum_value1 / count;
-			rec_to_write[sample_idx].value2 = sum_value2 / count;
-			rec_to_write[sample_idx].value3 = sum_value3 / count;
-			sample_idx++;
+// rollup files: <uuid>/YY/MM.bin (10 minutes), <uuid>/YY/hours.bin, <uuid>/days.bin (ring)
+static void rollup_filePath(char *file_path, uint32_t uuid, int level, uint32_t timestamp) {
+	rtc_date_t date = RTC_get_date(timestamp, 1970, TIME_OFFSET);
 
-			// Update for next sample
-			sum_timestamp = sum_value1 = sum_value2 = sum_value3 = count = 0;
+	if (level == ROLLUP_10MIN) {
+		snprintf(file_path, FILE_PATH_LEN, SD_POINT"/log/%08lX/%02d/%02d.bin",
+				uuid, date.year % 100, date.month);
+	}
+	else if (level == ROLLUP_HOURLY) {
+		snprintf(file_path, FILE_PATH_LEN, SD_POINT"/log/%08lX/%02d/hours.bin",
+				uuid, date.year % 100);
+	}
+	else {
+		snprintf(file_path, FILE_PATH_LEN, SD_POINT"/log/%08lX/days.bin", uuid);
+	}
+}
 
-			if (sample_idx < sample_count) {
-				active_sample_size = records_per_sample;
-				// Distribute extra samples accross the first samples
-				if (sample_idx < extra) active_sample_size++;
-			}
-		}
+// first timestamp after the rollup file of timestamp: next month, next year, never (ring)
+static uint32_t rollup_file_end(int level, uint32_t timestamp) {
+	rtc_date_t date = RTC_get_date(timestamp, 1970, TIME_OFFSET);
+
+	if (level == ROLLUP_10MIN) {
+		int next_year = date.year + (date.month == 12);
+		int next_month = (date.month % 12) + 1;
+		return RTC_get_seconds(next_year, next_month, 1, 0, 0, 0) + TIME_OFFSET;
 	}
+	if (level == ROLLUP_HOURLY) {
+		return RTC_get_seconds(date.year + 1, 1, 1, 0, 0, 0) + TIME_OFFSET;
+	}
+	return UINT32_MAX;
 }
 
-static void touch_series_filePath(
-	char *file_path, uint32_t uuid, int year, int month, int day, int file_idx
+//* @brief Series size of a day / rollup file: envelope_t for new files, record_t for older files
+static size_t record_file_series_size(const char *file_path) {
+	file_header_t header = {0};
+	series_get_header(file_path, &header);
+	if (header.magic != HEADER_MAGIC) return sizeof(envelope_t);
+	return header.series_size ? header.series_size : sizeof(record_t);
+}
+
+//* @brief Fit the envelopes to the file: projected onto their means for record_t files
+// returns the series size to write
+static size_t record_file_fit(const char *file_path, envelope_t *records, int count) {
+	size_t series_size = record_file_series_size(file_path);
+	if (series_size == sizeof(record_t)) envelope_to_records(records, count);
+	return series_size;
+}
+
+// ~12 bytes an envelope compressed instead of 30 - files of both kinds stay readable
+// a file written before envelopes keeps getting the means until the day / month / year rolls over
+static int record_file_insert(
+	const char *file_path, file_header_t *header, envelope_t *records, int count
 ) {
-	snprintf(file_path, FILE_PATH_LEN, SD_POINT"/log/%08lX/%02d/%02d%02d-%d.bin",
-			uuid, year, month, day, file_idx);
+	size_t series_size = record_file_fit(file_path, records, count);
+	#ifdef USE_COMPRESSED_SERIES
+		return series_compressed_insert(file_path, header, records, series_size, count);
+	#else
+		return series_segment_insert(file_path, header, records, series_size, count);
+	#endif
 }
 
 
 //# NOTE: Use 2 digits year
+// returns 0 when the day file path is ready, -1 otherwise
 static int prepare_aggregate_file(
 	char *file_path, active_records_t *active,
 	uint32_t uuid, int year, int month, int day
 ) {
 	static const char method_name[] = "prepare_aggregate_file";
-	const int INVALID_INDEX = -1;
+	const int INVALID_PATH = -1;
 	year = year % 1000;
 
-	//# Ensure year directory
-	if (active->curr_year != year) {
+	//# Ensure year directory - once a year, or after the manifest was forgotten
+	if (!day_manifest_loaded(&active->manifest, year)) {
 		ESP_LOGI(TAG_SF, "%s VALIDATE-PATH: for year %d", method_name, year);
 
 		// Get or Create UUID directory: /log/<uuid>
 		snprintf(file_path, FILE_PATH_LEN, SD_POINT"/log/%08lX", uuid);
 		if (!sd_ensure_dir(file_path)) {
 			ESP_LOGE(TAG_SF, "%s CREATE-PATH %s", method_name, file_path);
-			return INVALID_INDEX;
+			return INVALID_PATH;
 		}
 
 		// Get or Create year directory: /log/<uuid>/YY
 		snprintf(file_path, FILE_PATH_LEN, SD_POINT"/log/%08lX/%02d", uuid, year);
 		if (!sd_ensure_dir(file_path)) {
 			ESP_LOGE(TAG_SF, "%s CREATE-PATH %s", method_name, file_path);
-			return INVALID_INDEX;
+			return INVALID_PATH;
 		}
 
-		// update current year
-		active->curr_year = year;
-		// force month and day update
+		// list the day files once: lookups of the year are memory reads from here
+		// listed outside of the lock, published with the forced month and day update
+		day_manifest_t manifest;
+		day_manifest_load(&manifest, file_path, year);
+		printf("- Manifest: %d day files in %s\n", manifest.day_count, file_path);
+
+		device_stores_lock();
+		active->manifest = manifest;
 		active->curr_month = 0;
 		active->curr_day = 0;
+		device_stores_unlock();
 	}
 
-	//# Ensure month and day directory - Note: day and month can change between runs
-	if (active->curr_month != month && active->curr_day != day) {
+	//# Day rollover - Note: day and month can change between runs
+	if (active->curr_month != month || active->curr_day != day) {
 		ESP_LOGI(TAG_SF, "%s UPDATE-PATH: for %02d/%02d/%02d", method_name, year, month, day);
-		int latest_file_idx = 0;
-
-		for (int i = 0; i < RECORD_MAX_FILE_COUNT; i++) {
-			struct stat st;
-			// find the first available file
-			touch_series_filePath(file_path, uuid, year, month, day, i);
-
-			// stat ~6.5ms
-			if (stat(file_path, &st) != 0) break;	// File does not exist
-			latest_file_idx = i;
-		}
-
-		// check for max file reached
-		if (latest_file_idx >= RECORD_MAX_FILE_COUNT) {
-			ESP_LOGE(TAG_SF, "%s MAX-FILES reached: %d", method_name, latest_file_idx);
-			return INVALID_INDEX;
-		}
 
-		// double check if file_index has changed since last run (files may get deleted by user)
-		// this happens on insert: when the next offset exceeds the defined block size
-		if (latest_file_idx < active->file_index) {
-			latest_file_idx = active->file_index;
-		}
+		// flush and close the cached handles of the previous day
+		snprintf(file_path, FILE_PATH_LEN, SD_POINT"/log/%08lX/", uuid);
+		series_handle_evict(file_path);
 
-		// update active
+		device_stores_lock();
 		active->curr_month = month;
 		active->curr_day = day;
-		active->file_index = latest_file_idx;
+		device_stores_unlock();
 	}
 
-	//# build the complete path: /log/<uuid>/YY/MMDD-X.bin
-	// <uuid>/YY/MMDD-n.bin (max 6 hours - 360 records OR minutes)
-	// <uuid>/YY/MMDD-n+i.bin (Max 4 files per day - total 24 hours)
-	// max 1 minute a record: 10rec, 30rec, 60rec, 3hr=180rec, 6hr=360rec
-	touch_series_filePath(file_path, uuid, year, month, day, active->file_index);
+	//# build the complete path: /log/<uuid>/YY/MMDD.bin
+	// one segmented file per day, grows by 4KB blocks (1 minute records: 1440 a day, 5 blocks)
+	touch_day_filePath(file_path, uuid, year, month, day);
 	ESP_LOGI(TAG_SF, "%s PREPARING-FILE", method_name);
 	printf("- Start file: %s\n", file_path);
 
-	return active->file_index;
+	return 0;
 }
 
 #define BUFFER_SIZE sizeof(record_t) * AGGREGATE_SAMPLE_COUNT
@@ -362,6 +620,8 @@ static uint8_t test_data[BUFFER_SIZE];
 static nvs_handle_t my_handle;
 static record_t recs_to_read[AGGREGATE_SAMPLE_COUNT];
 
+static uint32_t cache_generation = 0;		// bumped on every aggregate cache change
+
 void cache_inject_records(
 	aggregate_cache_t *aggregate, record_t *new_records, int num_records
 ) {
@@ -385,6 +645,7 @@ void cache_inject_records(
 	// Update index (wrap around) and timestamps
 	aggregate->circular_index = (write_idx + num_records) % AGGREGATE_RECORD_COUNT;
 	aggregate->last_timestamp = new_records[num_records - 1].timestamp;
+	aggregate->generation = ++cache_generation;
 }
 
 static void reload_aggregate_specs(
@@ -393,6 +654,7 @@ static void reload_aggregate_specs(
 	if (record == NULL) {
 		// reset last aggregate values
 		active->last_aggregate_count = 0;
+		memset(active->buckets, 0, sizeof(active->buckets));
 	}
 	else {
 		// update records values
@@ -401,6 +663,24 @@ static void reload_aggregate_specs(
 		active->sec_records[idx].value1 = record->value1;
 		active->sec_records[idx].value2 = record->value2;
 		active->sec_records[idx].value3 = record->value3;
+		active->sec_records[idx].value4 = record->value4;
+
+		//# accumulate into the bucket of the second (the first record opens the window)
+		// the record closing the window lands in the last bucket
+		uint32_t offset = active->last_aggregate_sec ? timestamp - active->last_aggregate_sec : 0;
+		uint32_t bucket_idx = offset / AGGREGATE_BUCKET_SEC;
+		if (bucket_idx >= AGGREGATE_SAMPLE_COUNT) bucket_idx = AGGREGATE_SAMPLE_COUNT - 1;
+
+		aggregate_bucket_t *bucket = &active->buckets[bucket_idx];
+		const int16_t values[4] = {record->value1, record->value2, record->value3, record->value4};
+		bucket->sum_offsets += offset;
+
+		for (int i = 0; i < 4; i++) {
+			bucket->sum_values[i] += values[i];
+			if (!bucket->count || values[i] < bucket->min_values[i]) bucket->min_values[i] = values[i];
+			if (!bucket->count || values[i] > bucket->max_values[i]) bucket->max_values[i] = values[i];
+		}
+		bucket->count++;
 
 		active->last_aggregate_count++;
 		active->last_timestamp = timestamp;
@@ -408,29 +688,588 @@ static void reload_aggregate_specs(
 	}
 }
 
-static aggregate_cache_t *first_available_cache(uint32_t uuid) {
-	int cache_idx = -1;
-	aggregate_cache_t *aggregate_cache = NULL;
+//# Reorder window: samples over an unreliable network arrive late or swapped
+// sec_records, the buckets and every file behind them need timestamp order (binary searches)
+// a sample is held until REORDER_WINDOW_SEC newer ones came (or the window is full), older ones
+// slot in before it - behind the released samples it is late and never enters the records
+
+//* @brief Hold the sample in timestamp order, returns 0 when it is late or a duplicate
+static int reorder_push(active_records_t *active, const record_t *record) {
+	reorder_window_t *window = &active->reorder;
+	const uint32_t timestamp = record->timestamp;
+	if (timestamp <= active->last_timestamp) return 0;
+
+	// insertion from the end: in order samples don't move anything
+	int pos = window->count;
+	while (pos > 0 && window->pending[pos - 1].timestamp > timestamp) pos--;
+	if (pos > 0 && window->pending[pos - 1].timestamp == timestamp) return 0;
+
+	memmove(&window->pending[pos + 1], &window->pending[pos], (window->count - pos) * sizeof(record_t));
+	window->pending[pos] = *record;
+	window->count++;
+	if (timestamp > window->newest) window->newest = timestamp;
+	return 1;
+}
+
+//* @brief Pop the oldest sample when it left the window, returns 0 when none is ready
+// now (0: ignored) releases the samples of a device that went quiet
+static int reorder_pop(active_records_t *active, uint32_t now, record_t *out) {
+	reorder_window_t *window = &active->reorder;
+	if (!window->count) return 0;
+
+	const uint32_t timestamp = window->pending[0].timestamp;
+	if (window->count < REORDER_SLOTS &&
+		timestamp + REORDER_WINDOW_SEC > window->newest &&
+		(!now || timestamp + REORDER_WINDOW_SEC > now)
+	) {
+		return 0;
+	}
+
+	*out = window->pending[0];
+	window->count--;
+	memmove(&window->pending[0], &window->pending[1], window->count * sizeof(record_t));
+	return 1;
+}
+
+//# Hourly cache eviction: /g_rec recency and frequency
+// score = hits halved every CACHE_DECAY_SEC without a request: a dashboard device polled every
+// minute outranks one read once an hour ago, caches only fed by ingest (no hits) go first
+#define CACHE_DECAY_SEC 600
+
+static inline uint32_t cache_clock() {
+	return esp_timer_get_time() / 1000000;
+}
+
+static uint32_t cache_score(const aggregate_cache_t *cache, uint32_t now) {
+	uint32_t idle = (now - cache->last_access) / CACHE_DECAY_SEC;
+	if (idle > 24) return 0;
+	return (((uint32_t)cache->hits + 1) << 24) >> idle;
+}
+
+//* @brief Drop the coldest cache (never keep_uuid), returns 1 when a slot was freed
+static int aggregate_cache_evict(uint32_t keep_uuid) {
+	const uint32_t now = cache_clock();
+	aggregate_cache_t *victim = NULL;
+	uint32_t victim_score = UINT32_MAX;
+
+	for (int slot = 0; slot < AGGREGATE_POOL.capacity; slot++) {
+		aggregate_cache_t *cache = slab_pool_get(&AGGREGATE_POOL, slot);
+		if (!cache || !cache->uuid || cache->uuid == keep_uuid) continue;
+
+		uint32_t score = cache_score(cache, now);
+		if (score < victim_score || (
+			score == victim_score && (int32_t)(cache->last_access - victim->last_access) < 0
+		)) {
+			victim = cache;
+			victim_score = score;
+		}
+	}
+	if (!victim) return 0;
+
+	ESP_LOGW(TAG_SF, "aggregate_cache_evict CACHE-EVICTED: %08lX (%d hits)", victim->uuid, victim->hits);
+	int slot = uuid_index_release(&AGGREGATE_INDEX, victim->uuid);
+	slab_pool_put(&AGGREGATE_POOL, slot);
+	cache_stats.evictions++;
+	return 1;
+}
+
+//* @brief Returns the cache of the uuid - a new uuid takes a free slot
+// evict: when the slots or the memory run out the coldest cache makes room, NULL otherwise
+static aggregate_cache_t *first_available_cache(uint32_t uuid, int evict) {
+	int created;
+	int slot = uuid_index_acquire(&AGGREGATE_INDEX, uuid, &created);
+	if (slot < 0 && evict && aggregate_cache_evict(uuid)) {
+		slot = uuid_index_acquire(&AGGREGATE_INDEX, uuid, &created);
+	}
+	if (slot < 0) return NULL;
+
+	if (!created) return slab_pool_get(&AGGREGATE_POOL, slot);
+
+	// cache insert new UUID - a reused slot starts empty
+	aggregate_cache_t *aggregate_cache = slab_pool_take(&AGGREGATE_POOL, slot);
+	if (!aggregate_cache) {
+		uuid_index_release(&AGGREGATE_INDEX, uuid);		// out of memory
+
+		// the evicted slot is on top of the free stack: its slab is allocated
+		if (!evict || !aggregate_cache_evict(uuid)) return NULL;
+		slot = uuid_index_acquire(&AGGREGATE_INDEX, uuid, NULL);
+		aggregate_cache = slab_pool_take(&AGGREGATE_POOL, slot);
+		if (!aggregate_cache) {
+			uuid_index_release(&AGGREGATE_INDEX, uuid);
+			return NULL;
+		}
+	}
+	aggregate_cache->uuid = uuid;
+	aggregate_cache->last_access = cache_clock();
+	aggregate_cache->generation = ++cache_generation;
+	return aggregate_cache;
+}
+
+//###################################################
+//# STORAGE WRITER
+//###################################################
+// why: the SD insert takes ~20ms, keep it off the main loop
+// producers push aggregated batches to a bounded queue, the writer task owns all series writes
+// and write locks the stripe of the device per job: only the http reads of that stripe wait
+// the SD work runs outside of device_stores_lock, what it changes in memory (cache preloads,
+// manifests, day paths) is applied under it: the aggregator owns the same stores
+
+#define STORAGE_QUEUE_LEN 16
+#define STORAGE_TASK_STACK 4096
+#define STORAGE_TASK_PRIORITY 4
+
+typedef enum {
+	STORAGE_JOB_INSERT = 0,
+	STORAGE_JOB_PRELOAD,			// load the last hour into the aggregate cache
+	STORAGE_JOB_WARMUP,				// boot preload queued by the warm-up task
+	STORAGE_JOB_ADMIT,				// preload for a /g_rec miss, may evict a colder cache
+	STORAGE_JOB_ROLLUP,				// append a closed rollup bucket
+} storage_job_type_t;
+
+typedef struct {
+	uint32_t uuid;
+	uint32_t timestamp;
+	uint16_t year;
+	uint8_t month;
+	uint8_t day;
+	uint8_t type;
+	uint8_t count;
+	uint8_t level;					// rollup_level_t
+	envelope_t records[AGGREGATE_SAMPLE_COUNT];
+} storage_job_t;
+
+typedef struct {
+	uint32_t queued;
+	uint32_t written;
+	uint32_t dropped;				// queue full
+	uint32_t failed;				// insert failed
+	uint32_t high_water;			// max jobs waiting
+} storage_stats_t;
+
+typedef struct {
+	uint16_t total;					// devices to warm up
+	uint16_t queued;
+	uint16_t done;					// preloads run by the writer
+	uint16_t loaded;				// caches that found records
+	uint8_t running;
+} warmup_stats_t;
+
+static QueueHandle_t STORAGE_QUEUE = NULL;
+static storage_stats_t storage_stats = {0};
+static warmup_stats_t warmup_stats = {0};
+
+// returns the records loaded, 0 when the cache was already loaded (warm-up) or nothing was found
+static int storage_preload_cache(storage_job_t *job) {
+	const char method_name[] = "storage_preload_cache";
+	char file_path[FILE_PATH_LEN];
+	active_records_t *active = find_records_store(job->uuid);
+	if (!active) return 0;
+
+	int validate = prepare_aggregate_file(file_path, active, job->uuid, job->year, job->month, job->day);
+	if (validate < 0) return 0;
+
+	// already loaded (warm-up after the first records): no SD read
+	device_stores_lock();
+	aggregate_cache_t *loaded = find_aggregate_cache(job->uuid);
+	const int skip = loaded && loaded->last_timestamp;
+	device_stores_unlock();
+	if (skip) return 0;
+
+	// Find records that are in the last 1 hour OR 60 minutes ealier than timestamp
+	// the cache keeps the means: envelopes are read into the scratch and projected
+	// read outside of the lock: the aggregator keeps applying records meanwhile
+	static envelope_t preload_buffer[AGGREGATE_RECORD_COUNT];
+	size_t series_size = record_file_series_size(file_path);
+	int count = series_file_read_latest(file_path, job->timestamp - SECONDS_PER_HOUR,
+					preload_buffer, series_size, AGGREGATE_RECORD_COUNT);
+	if (count && series_size == sizeof(envelope_t)) envelope_to_records(preload_buffer, count);
+
+	//# apply under the lock of the aggregator - only /g_rec misses evict
+	// the slot is taken even without records: ingest fills it from here
+	// the aggregator may have filled the cache during the read: its records are newer, keep them
+	device_stores_lock();
+	const int evict = job->type == STORAGE_JOB_ADMIT;
+	aggregate_cache_t *aggregate_cache = first_available_cache(job->uuid, evict);
+
+	if (count && aggregate_cache && !aggregate_cache->last_timestamp) {
+		memcpy(aggregate_cache->min_records, preload_buffer, count * sizeof(record_t));
+
+		// the next inject follows the last loaded record
+		aggregate_cache->last_timestamp = aggregate_cache->min_records[count - 1].timestamp;
+		aggregate_cache->circular_index = count % AGGREGATE_RECORD_COUNT;
+		aggregate_cache->generation = ++cache_generation;
+	} else {
+		count = 0;
+	}
+	device_stores_unlock();
+
+	if (count) ESP_LOGI(TAG_SF, "%s CACHE-LOADED: %08lX %d records", method_name, job->uuid, count);
+	return count;
+}
+
+static void storage_write_records(storage_job_t *job) {
+	const char method_name[] = "storage_write_records";
+	char file_path[FILE_PATH_LEN];
+	uint64_t time_ref;
+
+	active_records_t *active = find_records_store(job->uuid);
+	if (!active) return;
+
+	//# Prepare file
+	int validate = prepare_aggregate_file(file_path, active, job->uuid, job->year, job->month, job->day);
+	if (validate < 0) {
+		storage_stats.failed++;
+		return;
+	}
+
+	//# Writing to storage
+	ESP_LOGI(TAG_SF, "%s LOG-AGGREGATE", method_name);
+	printf("- Writting %d records to: %s\n", job->count, file_path);
+
+	// ~20ms - into a local header, the active records only change under the lock
+	file_header_t header;
+	elapse_start(&time_ref);
+	int data_size = record_file_insert(file_path, &header, job->records, job->count);
+	uint64_t elapsed = elapse_stop(&time_ref);
+	ESP_LOGW(TAG_SF, "%s SD-INSERT duration: %lld us", method_name, elapsed);
+
+	if (!data_size) {
+		// invalid or full day file: force update file path for next cycle
+		ESP_LOGE(TAG_SF, "%s INVALID-FILE", method_name);
+		printf("- Failed to Insert: Force update file path for next cycle\n");
+		device_stores_lock();
+		day_manifest_forget(&active->manifest);
+		active->curr_month = 0;
+		active->curr_day = 0;
+		device_stores_unlock();
+		storage_stats.failed++;
+		return;
+	}
+
+	device_stores_lock();
+	active->last_header = header;
+	day_manifest_set(&active->manifest, job->month, job->day);
+	device_stores_unlock();
+	storage_stats.written++;
+}
+
+static void storage_write_rollup(storage_job_t *job) {
+	const char method_name[] = "storage_write_rollup";
+	char file_path[FILE_PATH_LEN];
+	file_header_t header;
+	int data_size;
+
+	rollup_filePath(file_path, job->uuid, job->level, job->timestamp);
+
+	if (job->level == ROLLUP_DAILY) {
+		size_t series_size = record_file_fit(file_path, job->records, job->count);
+		data_size = series_ring_create(file_path, series_size, ROLLUP_DAILY_CAPACITY) &&
+					series_batch_insert(file_path, &header, job->records, series_size, job->count);
+	} else {
+		data_size = record_file_insert(file_path, &header, job->records, job->count);
+	}
+
+	if (!data_size) {
+		ESP_LOGE(TAG_SF, "%s ROLLUP-FAILED", method_name);
+		printf("- Failed to Insert: %s\n", file_path);
+		storage_stats.failed++;
+		return;
+	}
+
+	storage_stats.written++;
+}
+
+static void storage_run_job(storage_job_t *job) {
+	if (job->type == STORAGE_JOB_PRELOAD) {
+		storage_preload_cache(job);
+	} else if (job->type == STORAGE_JOB_ADMIT) {
+		if (storage_preload_cache(job)) cache_stats.admits++;
+	} else if (job->type == STORAGE_JOB_WARMUP) {
+		if (storage_preload_cache(job)) warmup_stats.loaded++;
+		warmup_stats.done++;
+	} else if (job->type == STORAGE_JOB_ROLLUP) {
+		storage_write_rollup(job);
+	} else {
+		storage_write_records(job);
+	}
+}
+
+static void storage_writer_task(void *arg) {
+	storage_job_t job;
+
+	while (1) {
+		if (xQueueReceive(STORAGE_QUEUE, &job, portMAX_DELAY) != pdTRUE) continue;
+
+		// http readers only hold their stripe for a single read
+		fs_lock_t lock;
+		fs_lock_take(&lock, fs_lock_key_uuid(job.uuid), FS_LOCK_WRITE, FS_LOCK_FOREVER);
+		storage_run_job(&job);
+		fs_lock_give(&lock);
+	}
+}
+
+void storage_writer_start() {
+	const char method_name[] = "storage_writer_start";
+	if (STORAGE_QUEUE) return;
+
+	STORAGE_QUEUE = xQueueCreate(STORAGE_QUEUE_LEN, sizeof(storage_job_t));
+	if (!STORAGE_QUEUE) {
+		ESP_LOGE(TAG_SF, "%s QUEUE-FAILED", method_name);
+		return;
+	}
+
+	xTaskCreate(storage_writer_task, "storage_writer", STORAGE_TASK_STACK,
+				NULL, STORAGE_TASK_PRIORITY, NULL);
+	ESP_LOGI(TAG_SF, "%s WRITER-STARTED queue %d", method_name, STORAGE_QUEUE_LEN);
+}
+
+//* @brief Hand the job to the writer task - never blocks, drops the job if the queue is full
+// without writer task (SD not mounted yet) the job runs inline
+
+static int storage_queue_push(storage_job_t *job) {
+	const char method_name[] = "storage_queue_push";
+
+	if (!STORAGE_QUEUE) {
+		storage_run_job(job);
+		return 1;
+	}
+
+	if (xQueueSend(STORAGE_QUEUE, job, 0) != pdTRUE) {
+		storage_stats.dropped++;
+		ESP_LOGE(TAG_SF, "%s QUEUE-FULL: dropped %08lX (%ld total)",
+				method_name, job->uuid, storage_stats.dropped);
+		return 0;
+	}
+
+	storage_stats.queued++;
+	uint32_t waiting = STORAGE_QUEUE_LEN - uxQueueSpacesAvailable(STORAGE_QUEUE);
+	if (waiting > storage_stats.high_water) storage_stats.high_water = waiting;
+	return 1;
+}
+
+int storage_statsStr(char *buffer) {
+	storage_stats_t *stats = &storage_stats;
+	return sprintf(buffer, "Storage queue: %ld queued, %ld written, %ld dropped, %ld failed, peak %ld/%d\n",
+			stats->queued, stats->written, stats->dropped, stats->failed,
+			stats->high_water, STORAGE_QUEUE_LEN);
+}
+
+//###################################################
+//# CACHE WARM-UP
+//###################################################
+// why: the hourly caches were only loaded on the first record of a device - /g_rec (win 60-299)
+// returned nothing until then and that first record paid the SD read
+// a low priority task queues a preload of the last hour for every configured device,
+// the writer runs them between inserts: ingest never waits, the queue keeps a headroom for it
+
+#define WARMUP_TASK_STACK 3072
+#define WARMUP_TASK_PRIORITY 1					// below the writer and the main loop
+#define WARMUP_QUEUE_HEADROOM (STORAGE_QUEUE_LEN / 2)
+#define WARMUP_VALID_YEAR 2020					// wait for the clock before reading day files
+
+static void storage_warmup_task(void *arg) {
+	const char method_name[] = "storage_warmup_task";
+
+	//# Wait for a valid clock: the day file is picked from the date
+	time_t now = time(NULL);
+	rtc_date_t date = RTC_get_date(now, 1970, TIME_OFFSET);
+	while (date.year <= WARMUP_VALID_YEAR) {
+		vTaskDelay(pdMS_TO_TICKS(1000));
+		now = time(NULL);
+		date = RTC_get_date(now, 1970, TIME_OFFSET);
+	}
+
+	ESP_LOGI(TAG_SF, "%s WARMUP-START: %d devices", method_name, warmup_stats.total);
+	for (int slot = 0; slot < ACTIVE_POOL.capacity; slot++) {
+		active_records_t *active = active_records_at(slot);
+		if (!active) continue;
+
+		// leave the queue to ingest while it's busy
+		while (uxQueueSpacesAvailable(STORAGE_QUEUE) < WARMUP_QUEUE_HEADROOM) {
+			vTaskDelay(pdMS_TO_TICKS(50));
+		}
+
+		storage_job_t job = {
+			.uuid = active->uuid,
+			.timestamp = now,
+			.year = date.year,
+			.month = date.month,
+			.day = date.day,
+			.type = STORAGE_JOB_WARMUP,
+		};
+		if (storage_queue_push(&job)) warmup_stats.queued++;
+	}
+
+	ESP_LOGI(TAG_SF, "%s WARMUP-QUEUED: %d/%d", method_name, warmup_stats.queued, warmup_stats.total);
+	warmup_stats.running = 0;
+	vTaskDelete(NULL);
+}
+
+//* @brief Preload the hourly caches of the configured devices in the background
+// call after sd_load_config and storage_writer_start
+void storage_warmup_start() {
+	const char method_name[] = "storage_warmup_start";
+	if (!STORAGE_QUEUE || warmup_stats.running) return;
+
+	memset(&warmup_stats, 0, sizeof(warmup_stats));
+	warmup_stats.total = ACTIVE_INDEX.count;
+	if (!warmup_stats.total) return;
+
+	warmup_stats.running = 1;
+	if (xTaskCreate(storage_warmup_task, "storage_warmup", WARMUP_TASK_STACK,
+					NULL, WARMUP_TASK_PRIORITY, NULL) != pdPASS) {
+		ESP_LOGE(TAG_SF, "%s TASK-FAILED", method_name);
+		warmup_stats.running = 0;
+	}
+}
+
+int storage_warmup_statsStr(char *buffer) {
+	warmup_stats_t *stats = &warmup_stats;
+	return sprintf(buffer, "Cache warm-up: %d/%d preloaded (%d loaded, %d queued)%s\n",
+			stats->done, stats->total, stats->loaded, stats->queued,
+			stats->running ? " running" : "");
+}
+
+//###################################################
+//# HOURLY CACHE ACCESS
+//###################################################
+
+//* @brief Copy the hourly cache of a /g_rec request, returns 0 on a miss
+// records: AGGREGATE_RECORD_COUNT records, tag: generation and last timestamp of the copy (ETag)
+// copied under the device stores lock - the aggregator injects and the writer evicts meanwhile
+// a hit refreshes the cache score, a miss queues its admission: the writer loads the last hour
+// and evicts the coldest cache when all slots are taken - the next request is a hit
+
+int aggregate_cache_read(uint32_t uuid, record_t *records, uint32_t tag[2]) {
+	const uint32_t now = cache_clock();
+	device_stores_lock();
+	aggregate_cache_t *cache = find_aggregate_cache(uuid);
+
+	if (cache && cache->last_timestamp) {
+		cache->hits++;
+		cache->last_access = now;
+		cache_stats.hits++;
+		memcpy(records, cache->min_records, sizeof(cache->min_records));
+		tag[0] = cache->generation;
+		tag[1] = cache->last_timestamp;
+		device_stores_unlock();
+		return 1;
+	}
 
-	// if doesn't exist
-	for (int i = 0; i < AGGREGATE_CACHE_COUNT; i++) {
-		// UUID cache - non ordering
-		if (AGGREGATE_CACHE_UUIDS[i] == 0) cache_idx = i;
+	if (cache) {
+		cache->misses++;
+		cache->last_access = now;
+	}
+	cache_stats.misses++;
+	device_stores_unlock();
+
+	time_t timestamp = time(NULL);
+	rtc_date_t date = RTC_get_date(timestamp, 1970, TIME_OFFSET);
+	storage_job_t job = {
+		.uuid = uuid,
+		.timestamp = timestamp,
+		.year = date.year,
+		.month = date.month,
+		.day = date.day,
+		.type = STORAGE_JOB_ADMIT,
+	};
+	storage_queue_push(&job);
+	return 0;
+}
 
-		if (AGGREGATE_CACHE_UUIDS[i] == uuid) {
-			// Found existing UUID
-			aggregate_cache = &AGGREGATE_CACHE[i];
+// per slot lines while they fit buffer_size
+int aggregate_cache_statsStr(char *buffer, size_t buffer_size) {
+	const uint32_t now = cache_clock();
+	cache_stats_t *stats = &cache_stats;
+	int pos = snprintf(buffer, buffer_size,
+					"Hourly caches: %d/%d, %ld hits, %ld misses, %ld admitted, %ld evicted\n",
+					AGGREGATE_INDEX.count, AGGREGATE_POOL.capacity, stats->hits, stats->misses,
+					stats->admits, stats->evictions);
+
+	for (int slot = 0; slot < AGGREGATE_POOL.capacity && pos < buffer_size; slot++) {
+		aggregate_cache_t *cache = slab_pool_get(&AGGREGATE_POOL, slot);
+		if (!cache || !cache->uuid) continue;
+
+		int written = snprintf(buffer + pos, buffer_size - pos, "- [%d] %08lX: %d hits, %d misses, idle %lds\n",
+					slot, cache->uuid, cache->hits, cache->misses, now - cache->last_access);
+		if (written >= buffer_size - pos) {
+			buffer[pos] = '\0';		// drop the partial line
 			break;
 		}
+		pos += written;
+	}
+	return pos;
+}
+
+//###################################################
+//# ROLLUP PYRAMID
+//###################################################
+// why: a 30 days or 1 year plot should read a few hundred records, not every 1 minute record
+// the 1 minute aggregates feed the 10 minutes bucket, a closed bucket feeds the level above
+// with its sums, extremes and count (exact means and envelopes, nothing is read back from SD)
+// buckets are aligned on local time and stamped with their start time
+
+static void rollup_emit(uint32_t uuid, int level, rollup_t *rollup) {
+	uint32_t start = rollup->bucket * ROLLUP_PERIOD_SEC[level] + TIME_OFFSET;
+	storage_job_t job = {
+		.uuid = uuid,
+		.timestamp = start,
+		.type = STORAGE_JOB_ROLLUP,
+		.count = 1,
+		.level = level,
+	};
+
+	envelope_t *rec = &job.records[0];
+	rec->timestamp = start;
+	rec->value1 = rollup->sum_values[0] / rollup->count;
+	rec->value2 = rollup->sum_values[1] / rollup->count;
+	rec->value3 = rollup->sum_values[2] / rollup->count;
+	rec->value4 = rollup->sum_values[3] / rollup->count;
+	memcpy(rec->min_values, rollup->min_values, sizeof(rec->min_values));
+	memcpy(rec->max_values, rollup->max_values, sizeof(rec->max_values));
+	rec->count = rollup->count;
+	storage_queue_push(&job);
+}
+
+//* @brief Add sums and extremes to the bucket of timestamp, closing the open bucket when it changes
+static void rollup_merge(
+	uint32_t uuid, active_records_t *active, int level, uint32_t timestamp,
+	const int32_t *sum_values, const int16_t *min_values, const int16_t *max_values, uint16_t count
+) {
+	rollup_t *rollup = &active->rollups[level];
+	uint32_t bucket = (timestamp - TIME_OFFSET) / ROLLUP_PERIOD_SEC[level];
+
+	if (rollup->count && rollup->bucket != bucket) {
+		rollup_emit(uuid, level, rollup);
+
+		if (level + 1 < ROLLUP_LEVEL_COUNT) {
+			uint32_t start = rollup->bucket * ROLLUP_PERIOD_SEC[level] + TIME_OFFSET;
+			rollup_merge(uuid, active, level + 1, start, rollup->sum_values,
+						rollup->min_values, rollup->max_values, rollup->count);
+		}
+		memset(rollup, 0, sizeof(rollup_t));
 	}
 
-	// cache insert new UUID - if it doesn't exist
-	if (cache_idx != -1 && aggregate_cache == NULL) {
-		AGGREGATE_CACHE_UUIDS[cache_idx] = uuid;
-		aggregate_cache = &AGGREGATE_CACHE[cache_idx];
+	for (int i = 0; i < 4; i++) {
+		rollup->sum_values[i] += sum_values[i];
+		if (!rollup->count || min_values[i] < rollup->min_values[i]) rollup->min_values[i] = min_values[i];
+		if (!rollup->count || max_values[i] > rollup->max_values[i]) rollup->max_values[i] = max_values[i];
 	}
+	rollup->bucket = bucket;
+	rollup->count += count;
+}
 
-	return aggregate_cache;
+static void rollup_feed(uint32_t uuid, active_records_t *active, const envelope_t *records, int count) {
+	for (int i = 0; i < count; i++) {
+		const envelope_t *record = &records[i];
+		if (!record->timestamp) continue;		// empty sample
+
+		int32_t sum_values[4] = {record->value1, record->value2, record->value3, record->value4};
+		int16_t min_values[4], max_values[4];
+		memcpy(min_values, record->min_values, sizeof(min_values));
+		memcpy(max_values, record->max_values, sizeof(max_values));
+		rollup_merge(uuid, active, ROLLUP_10MIN, record->timestamp, sum_values, min_values, max_values, 1);
+	}
 }
 
 static void cache_n_write_record(
@@ -440,14 +1279,14 @@ static void cache_n_write_record(
 	active_records_t *active = find_records_store(uuid);
 	if (!active) return;
 
-	uint16_t idx = active->record_idx;
 	uint32_t timestamp = record->timestamp;
-	uint64_t time_ref;
-	file_header_t header;
-	int validate;
-
-	char file_path[FILE_PATH_LEN];
-	record_t recs_to_write[AGGREGATE_SAMPLE_COUNT] = {0};
+	storage_job_t job = {
+		.uuid = uuid,
+		.timestamp = timestamp,
+		.year = year,
+		.month = month,
+		.day = day,
+	};
 
 	//# Found existing UUID - update record
 	reload_aggregate_specs(active, record, timestamp);
@@ -457,22 +1296,9 @@ static void cache_n_write_record(
 		active->last_aggregate_sec = timestamp;
 		ESP_LOGE(TAG_SF, "%s PRELOADING-CACHE", method_name);
 
-		//! load cache here
-		validate = prepare_aggregate_file(file_path, active, uuid, year, month, day);
-		if (validate < 0) return;
-
-		// find an available cache slot and inject records
-		aggregate_cache_t *aggregate_cache = first_available_cache(uuid);
-		if (!aggregate_cache) return;
-
-		// Find records that are in the last 1 hour OR 60 minutes ealier than timestamp
-		int count = series_file_read_latest(file_path, timestamp - SECONDS_PER_HOUR,
-						&aggregate_cache->min_records, sizeof(record_t), AGGREGATE_RECORD_COUNT);
-		if (!count) return;
-
-		aggregate_cache->last_timestamp = aggregate_cache->min_records[count - 1].timestamp;
-		aggregate_cache->circular_index = count - 1;
-
+		//! load cache on the writer task
+		job.type = STORAGE_JOB_PRELOAD;
+		storage_queue_push(&job);
 		return;
 	}
 	//# handle aggregate intervals
@@ -482,64 +1308,27 @@ static void cache_n_write_record(
 	// update interval timestamp
 	active->last_aggregate_sec = timestamp;
 
-	//# aggregate records ~200us for 5 samples of 60 seconds
-	aggregate_records(active, recs_to_write, AGGREGATE_SAMPLE_COUNT);
+	//# close the 5 running buckets of 60 seconds
+	job.count = aggregate_records(active, job.records, AGGREGATE_SAMPLE_COUNT);
 
-	//# Handle cache
-	aggregate_cache_t *aggregate_cache = first_available_cache(uuid);
-	if (aggregate_cache) {
-		// inject records
-		cache_inject_records(aggregate_cache, recs_to_write, AGGREGATE_SAMPLE_COUNT);
+	//# Handle cache - ingest takes free slots only, /g_rec decides what stays
+	aggregate_cache_t *aggregate_cache = first_available_cache(uuid, 0);
+	if (aggregate_cache && job.count) {
+		// inject the means - the cache stays record_t
+		record_t means[AGGREGATE_SAMPLE_COUNT];
+		for (int i = 0; i < job.count; i++) memcpy(&means[i], &job.records[i], sizeof(record_t));
+		cache_inject_records(aggregate_cache, means, job.count);
 	}
 
-	//# Prepare file
-	validate = prepare_aggregate_file(file_path, active, uuid, year, month, day);
-	if (validate < 0) return;
-
-	//# Writing to storage
-	ESP_LOGI(TAG_SF, "%s LOG-AGGREGATE", method_name);
-	printf("- Writting %d records to: %s\n", AGGREGATE_SAMPLE_COUNT, file_path);
-
 	#ifdef USE_SD_STORAGE
-		//# Log to storage
-		uint64_t elapsed;
-
-		//# inject the last timestamp on insert
-		active->last_header.last_timestamp = timestamp;
-
-		// ~20ms
-		elapse_start(&time_ref);
-		int next_offset = series_batch_insert(file_path, &active->last_header, recs_to_write,
-											sizeof(record_t), AGGREGATE_SAMPLE_COUNT);
-		elapsed = elapse_stop(&time_ref);
-		ESP_LOGW(TAG_SF, "%s SD-INSERT duration: %lld us", method_name, elapsed);
-
-		if (!next_offset) {
-			// force update file path for next cycle
-			ESP_LOGE(TAG_SF, "%s INVALID-FILE", method_name);
-			printf("- Failed to Insert: Force update file path for next cycle\n");
-			active->curr_year = 0;
-			active->curr_month = 0;
-			active->curr_day = 0;
-			active->file_index = 0;
-			return;
-		}
-		else if (next_offset > RECORD_FILE_BLOCK_SIZE) {
-			// TODO: Handle overflow offset when file loaded
-			ESP_LOGE(TAG_SF, "%s FILE-FULL", method_name);
-			printf("- Failed to Insert: Force update file path for next cycle\n");
-			// increase the file_index an reset dates to make a new file next time
-			active->curr_month = 0;
-			active->curr_day = 0;
-			active->file_index++;
-		}
+	if (job.count) {
+		//# Log to storage - the writer task does the ~20ms insert
+		job.type = STORAGE_JOB_INSERT;
+		storage_queue_push(&job);
 
-		// ~10ms
-		elapse_start(&time_ref);
-		int len = series_file_read_all(&header, file_path, recs_to_read,
-									sizeof(record_t), AGGREGATE_SAMPLE_COUNT);	// ~10ms
-		elapsed = elapse_stop(&time_ref);
-		ESP_LOGW(TAG_SF, "%s SD-READ duration: %lld us", method_name, elapsed);
+		//# Roll the 1 minute records up - closed buckets follow the insert in the queue
+		rollup_feed(uuid, active, job.records, job.count);
+	}
 	#endif
 
 	//######################################
@@ -572,51 +1361,256 @@ static void cache_n_write_record(
 }
 
 
+//###################################################
+//# BATCH INGEST
+//###################################################
+// why: sensors push batches of records from httpd workers and other network tasks
+// producers only check the timestamp range and push to the lock-free INGEST_RING: they never
+// wait on a lock or the SD - a single aggregator task drains it in batches into the active records
+// before ingest_start (no aggregator) the batch is applied inline under INGEST_MUTEX
+
+#define INGEST_MIN_TIMESTAMP 1609459200			// 2021-01-01: older means an unset sensor clock
+#define INGEST_MAX_AHEAD_SEC 300				// tolerated clock drift ahead of ours
+#define INGEST_DRAIN_BATCH 64					// tuples applied per INGEST_MUTEX hold
+#define INGEST_TASK_STACK 4096
+#define INGEST_TASK_PRIORITY 5					// above the writer: drains before it takes the jobs
+#define INGEST_IDLE_MS 1000						// drain even if a notification was missed
+
+// wire format: 16 bytes a record, little endian as record_t
+typedef struct __attribute__((packed)) {
+	uint32_t uuid;
+	record_t record;
+} ingest_tuple_t;
+
+typedef struct {
+	uint32_t accepted;				// applied (no aggregator running)
+	uint32_t queued;				// handed to the aggregator: applied or rejected there (ingest_stats)
+	uint32_t unknown;				// uuid not registered
+	uint32_t out_of_range;			// timestamp before 2021 or ahead of the clock (checked first)
+	uint32_t out_of_order;			// late: behind the reorder window, or a duplicate timestamp
+	uint32_t dropped;				// refused by the full ring
+} ingest_result_t;
+
+typedef struct {
+	uint32_t batches;
+	uint32_t accepted;
+	uint32_t rejected;
+	uint32_t peak_rate;				// records per second of the fastest batch
+	uint32_t drains;				// aggregator batches
+	uint32_t late;					// samples behind the reorder window
+} ingest_stats_t;
+
+static ingest_stats_t ingest_stats = {0};
+static ingest_ring_t INGEST_RING = {0};
+static TaskHandle_t INGEST_TASK = NULL;
+
+// the date of a record only changes at local midnight
+typedef struct {
+	uint32_t day_start;
+	uint32_t day_end;
+	rtc_date_t date;
+} ingest_day_t;
+
+static inline uint32_t ingest_rejected(const ingest_result_t *result) {
+	return result->unknown + result->out_of_range + result->out_of_order + result->dropped;
+}
+
+static inline int ingest_in_range(uint32_t timestamp, uint32_t max_timestamp) {
+	return timestamp >= INGEST_MIN_TIMESTAMP && timestamp <= max_timestamp;
+}
+
+static inline uint32_t ingest_max_timestamp() {
+	const uint32_t now = time(NULL);
+	return now > INGEST_MIN_TIMESTAMP ? now + INGEST_MAX_AHEAD_SEC : UINT32_MAX;
+}
+
+//* @brief Feed the samples out of the reorder window to the records, in timestamp order
+static void ingest_release(active_records_t *active, uint32_t now, ingest_day_t *day) {
+	record_t record;
+
+	while (reorder_pop(active, now, &record)) {
+		if (record.timestamp < day->day_start || record.timestamp >= day->day_end) {
+			day->date = RTC_get_date(record.timestamp, 1970, TIME_OFFSET);
+			day->day_start = record.timestamp - (record.timestamp - TIME_OFFSET) % 86400;
+			day->day_end = day->day_start + 86400;
+		}
+
+		cache_n_write_record(active->uuid, &record, day->date.year, day->date.month, day->date.day);
+	}
+}
+
+//* @brief Apply one in range tuple to the active records - INGEST_MUTEX held
+// accepted = in the reorder window, released to cache_n_write_record once it is in order
+static void ingest_apply(const ingest_tuple_t *tuple, ingest_day_t *day, ingest_result_t *counts) {
+	const uint32_t uuid = tuple->uuid;
+	record_t record = tuple->record;		// packed source: copy out
+
+	// seen devices are listed for registration, registered or not
+	cache_device(uuid, record.timestamp);
+
+	active_records_t *active = find_records_store(uuid);
+	if (!active) {
+		counts->unknown++;
+		return;
+	}
+	if (!reorder_push(active, &record)) {
+		counts->out_of_order++;
+		return;
+	}
+
+	counts->accepted++;
+	ingest_release(active, 0, day);
+}
+
+//* @brief Release the samples of every device idle for REORDER_WINDOW_SEC - INGEST_MUTEX held
+static void ingest_flush_windows(uint32_t now) {
+	ingest_day_t day = {0};
+
+	for (int slot = 0; slot < ACTIVE_POOL.capacity; slot++) {
+		active_records_t *active = active_records_at(slot);
+		if (active && active->reorder.count) ingest_release(active, now, &day);
+	}
+}
+
+//* @brief Validate and ingest count tuples, result (optional) gets the accepted/queued/rejected counts
+// returns the tuples taken (accepted + queued) - the batch is processed in order, rejects don't stop it
+// with the aggregator running only the range is checked here: unknown / out_of_order of the queued
+// tuples land in ingest_stats
+
+int ingest_records(const ingest_tuple_t *tuples, int count, ingest_result_t *result) {
+	ingest_result_t counts = {0};
+	const uint32_t max_timestamp = ingest_max_timestamp();
+	const int queued = INGEST_TASK != NULL;
+
+	uint64_t time_ref;
+	elapse_start(&time_ref);
+	ingest_day_t day = {0};
+	if (!queued) device_stores_lock();
+
+	for (int i = 0; i < count; i++) {
+		if (!ingest_in_range(tuples[i].record.timestamp, max_timestamp)) {
+			counts.out_of_range++;
+		}
+		else if (!queued) {
+			ingest_apply(&tuples[i], &day, &counts);
+		}
+		else if (ingest_ring_push(&INGEST_RING, &tuples[i])) {
+			counts.queued++;
+		}
+		else {
+			counts.dropped++;
+		}
+	}
+
+	if (!queued) ingest_flush_windows(time(NULL));
+	if (!queued) device_stores_unlock();
+	if (counts.queued) xTaskNotifyGive(INGEST_TASK);
+	uint64_t elapsed = elapse_stop(&time_ref);
+
+	// producers run in several tasks
+	__atomic_fetch_add(&ingest_stats.batches, 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&ingest_stats.rejected, ingest_rejected(&counts), __ATOMIC_RELAXED);
+	if (!queued) __atomic_fetch_add(&ingest_stats.accepted, counts.accepted, __ATOMIC_RELAXED);
+	if (!queued) __atomic_fetch_add(&ingest_stats.late, counts.out_of_order, __ATOMIC_RELAXED);
+	if (elapsed && count) {
+		uint32_t rate = (uint64_t)count * 1000000 / elapsed;
+		if (rate > ingest_stats.peak_rate) ingest_stats.peak_rate = rate;
+	}
+
+	if (result) *result = counts;
+	return counts.accepted + counts.queued;
+}
+
+static void ingest_aggregator_task(void *arg) {
+	static ingest_tuple_t batch[INGEST_DRAIN_BATCH];
+
+	while (1) {
+		ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(INGEST_IDLE_MS));
+
+		int count;
+		while ((count = ingest_ring_pop_batch(&INGEST_RING, batch, INGEST_DRAIN_BATCH)) > 0) {
+			ingest_result_t counts = {0};
+			ingest_day_t day = {0};
+			// the range was checked by the producer, the clock only moves forward since
+			device_stores_lock();
+			for (int i = 0; i < count; i++) {
+				ingest_apply(&batch[i], &day, &counts);
+			}
+			device_stores_unlock();
+
+			__atomic_fetch_add(&ingest_stats.accepted, counts.accepted, __ATOMIC_RELAXED);
+			__atomic_fetch_add(&ingest_stats.rejected, ingest_rejected(&counts), __ATOMIC_RELAXED);
+			__atomic_fetch_add(&ingest_stats.late, counts.out_of_order, __ATOMIC_RELAXED);
+			ingest_stats.drains++;
+		}
+
+		// samples of the devices that went quiet
+		device_stores_lock();
+		ingest_flush_windows(time(NULL));
+		device_stores_unlock();
+	}
+}
+
+//* @brief Start the aggregator task with a ring of capacity tuples (16 bytes + 4 each)
+// call after device_pool_init - ingest_records applies inline until then
+esp_err_t ingest_start(uint32_t capacity, ingest_ring_policy_t policy) {
+	const char method_name[] = "ingest_start";
+	if (INGEST_TASK) return ESP_OK;
+	if (!INGEST_MUTEX) return ESP_FAIL;
+
+	if (!ingest_ring_create(&INGEST_RING, capacity, sizeof(ingest_tuple_t), policy)) {
+		ESP_LOGE(TAG_SF, "%s RING-FAILED: %ld tuples", method_name, capacity);
+		return ESP_FAIL;
+	}
+
+	if (xTaskCreate(ingest_aggregator_task, "ingest_aggregator", INGEST_TASK_STACK,
+					NULL, INGEST_TASK_PRIORITY, &INGEST_TASK) != pdPASS) {
+		ESP_LOGE(TAG_SF, "%s TASK-FAILED", method_name);
+		ingest_ring_free(&INGEST_RING);
+		INGEST_TASK = NULL;
+		return ESP_FAIL;
+	}
+
+	ESP_LOGI(TAG_SF, "%s AGGREGATOR-STARTED ring %ld (%s)", method_name,
+			ingest_ring_capacity(&INGEST_RING), policy == INGEST_RING_DROP_OLDEST ? "drop oldest" : "reject");
+	return ESP_OK;
+}
+
+int ingest_statsStr(char *buffer) {
+	ingest_stats_t *stats = &ingest_stats;
+	int len = sprintf(buffer, "Ingest: %ld batches, %ld accepted, %ld rejected (%ld late), peak %ld records/s\n",
+			stats->batches, stats->accepted, stats->rejected, stats->late, stats->peak_rate);
+	if (!INGEST_TASK) return len;
+
+	ingest_ring_t *ring = &INGEST_RING;
+	return len + sprintf(buffer + len, "Ingest ring: %ld/%ld waiting, %ld drained in %ld, %ld dropped, %ld rejected, peak %ld\n",
+			ingest_ring_depth(ring), ingest_ring_capacity(ring), ring->popped, stats->drains,
+			ring->dropped, ring->rejected, ring->high_water);
+}
+
+
 // /log/<uuid>/new_0.bin - 1 second records with 30 minutes rotation A (1Hz = 1800 points)
 // /log/<uuid>/new_1.bin - 1 second records with 30 minutes rotation B (1Hz = 1800 points)
-// /log/<uuid>/2025/1230.bin - 1 minute records of 24 hours (1/min = 1440 points OR 60 per hour)
-// /log/<uuid>/2025/12.bin - 10 minutes records of 30 days(1/10min = 4320 records OR 144 per day)
+// /log/<uuid>/25/1230.bin - 1 minute records of 24 hours (1/min = 1440 points OR 60 per hour)
+// /log/<uuid>/25/12.bin - 10 minutes rollup of the month (1/10min = 4464 records max OR 144 per day)
+// /log/<uuid>/25/hours.bin - hourly rollup of the year (8784 records max)
+// /log/<uuid>/days.bin - daily rollup ring (ROLLUP_DAILY_CAPACITY days)
 
 #define BUFFER_DURATION_SEC 1800  // 30 minutes
-#define FILE_SIZE (10*1800)		// 1800 records 10 bytes each
+#define RAW_RING_CAPACITY BUFFER_DURATION_SEC	// 1800 records 12 bytes each
 
 static void rotation_get_filePath(uint32_t device_id, int target, char *file_path) {
 	snprintf(file_path, FILE_PATH_LEN, SD_POINT"/log/%08lX/new_%d.bin",
 			device_id, target);
 }
 
-void append_to_circular_buffer(const char* file_path, const void* data, size_t size) {
-	static size_t write_pos = 0;
+//* @brief Append 1Hz records to a fixed size ring series file (oldest records are overwritten)
+// the ring keeps its own write cursor in the header: constant file size, no new files
+void append_to_circular_buffer(const char* file_path, const record_t* records, int count) {
+	if (!series_ring_create(file_path, sizeof(record_t), RAW_RING_CAPACITY)) return;
 
-	FILE* f = fopen(file_path, "rb+");
-	if (!f) {
-		// Create fixed-size file on first run
-		printf("*** Creating file %s\n", file_path);
-		f = fopen(file_path, "wb");
-		if (f) {
-			// Pre-allocate file size
-			uint8_t zero_buffer[512] = {0};
-			size_t remaining = FILE_SIZE;
-
-			// fill with zeros
-			while (remaining > 0) {
-				size_t to_write = (remaining > sizeof(zero_buffer)) ?
-								sizeof(zero_buffer) : remaining;
-				fwrite(zero_buffer, 1, to_write, f);
-				remaining -= to_write;
-			}
-			fclose(f);
-			f = fopen(file_path, "rb+");
-		}
-	}
-
-	if (f) {
-		// printf("*** writing file %s at pos %d\n", file_path, write_pos);
-		fseek(f, write_pos, SEEK_SET);
-		fwrite(data, 1, size, f);
-		write_pos = (write_pos + size) % FILE_SIZE;
-		fclose(f);
-	}
+	file_header_t header;
+	series_batch_insert(file_path, &header, records, sizeof(record_t), count);
 }
 
 
@@ -624,26 +1618,24 @@ void append_to_circular_buffer(const char* file_path, const void* data, size_t s
 static esp_err_t sd_save_config(uint32_t uuid, uint32_t config) {
 	const char method_name[] = "sd_save_config";
 
-	// need 2 passes
-	for (int i = 0; i < ACTIVE_RECORDS_COUNT; i++) {
-		active_records_t *active = &ACTIVE_RECORDS[i];
+	//# registry change under the lock of the aggregator: it may be applying records of the uuid
+	device_stores_lock();
 
-		//# overwrite existing uuid's config
-		if (active->uuid == uuid) {
-			active->config = config;
-			break;
-		}
-		if (active->uuid == 0) {
-			//! Assumption: First empty slot, the rest are uuid = 0
-			// UUID is new - add to empty slot and break loop
-			active->uuid = uuid;
-			active->config = config;		// default config
-
-			// update UUID_ARRAY
-			ACTIVE_UUIDS[i] = uuid;
-			break;
+	//# config 0 deletes the device (never loaded back) - its slot is reused
+	if (config == 0) {
+		remove_device(uuid);
+	}
+	else {
+		//# overwrite existing uuid's config OR register the new uuid
+		active_records_t *active = register_records_store(uuid);
+		if (!active) {
+			device_stores_unlock();
+			ESP_LOGE(TAG_SF, "%s DEVICES-FULL: %d", method_name, ACTIVE_POOL.capacity);
+			return ESP_FAIL;
 		}
+		active->config = config;
 	}
+	device_stores_unlock();
 
 	const char *file_path = SD_POINT"/log/config.txt";
 	FILE *f = fopen(file_path, "w");	 // overwrite - create if doesn't exit
@@ -653,10 +1645,15 @@ static esp_err_t sd_save_config(uint32_t uuid, uint32_t config) {
 		return ESP_FAIL;
 	}
 
-	for (int i = 0; i < ACTIVE_RECORDS_COUNT; i++) {
-		active_records_t *active = &ACTIVE_RECORDS[i];
-		if (active->uuid == 0) continue;
-		fprintf(f, "%08lX %ld\n", active->uuid, active->config);
+	// one slot at a time: the lock is never held across the SD write
+	for (int i = 0; i < ACTIVE_POOL.capacity; i++) {
+		device_stores_lock();
+		active_records_t *active = active_records_at(i);
+		const uint32_t slot_uuid = active ? active->uuid : 0;
+		const uint32_t slot_config = active ? active->config : 0;
+		device_stores_unlock();
+
+		if (slot_uuid) fprintf(f, "%08lX %ld\n", slot_uuid, slot_config);
 	}
 
 	fclose(f);
@@ -695,14 +1692,19 @@ static esp_err_t sd_load_config() {
 		//! filter for valid uuid and config
 		if (uuid == 0 || config == 0) continue;
 
-		// update active uuid array
-		ACTIVE_UUIDS[active_idx] = uuid;
-
 		// update active records
-		active_records_t *active = &ACTIVE_RECORDS[active_idx];
-		active->uuid = uuid;
-		active->config = config;
-		memset(active->sec_records, 0, sizeof(active->sec_records));
+		device_stores_lock();
+		active_records_t *active = register_records_store(uuid);
+		if (active) {
+			active->config = config;
+			memset(active->sec_records, 0, sizeof(active->sec_records));
+		}
+		device_stores_unlock();
+
+		if (!active) {
+			ESP_LOGE(TAG_SF, "%s DEVICES-FULL: %d", method_name, ACTIVE_POOL.capacity);
+			break;
+		}
 
 		active_idx++;
 		ESP_LOGW(TAG_SF, "%s CONFIG-LOADED", method_name);
@@ -725,11 +1727,11 @@ static int make_device_configs_str(char *buffer, size_t buffer_size) {
 	int count = 0;
 	*ptr++ = '[';
 
-	for (int i = 0; i < ACTIVE_RECORDS_COUNT; i++) {
-		active_records_t *active = &ACTIVE_RECORDS[i];
+	for (int i = 0; i < ACTIVE_POOL.capacity; i++) {
+		active_records_t *active = active_records_at(i);
 
 		//! filter for valid uuid and config
-		if (active->uuid == 0 || active->config == 0) continue;
+		if (!active || active->config == 0) continue;
 		if (count > 0) *ptr++ = ',';
 
 		int written = snprintf(ptr, buffer_size - (ptr - buffer),
@@ -757,9 +1759,9 @@ static int make_device_caches_str(char *buffer, size_t buffer_size) {
 	char *ptr = buffer;
 	*ptr++ = '[';
 
-	for (int i = 0; i < ACTIVE_RECORDS_COUNT; i++) {
+	for (int i = 0; i < DEVICE_INDEX.slot_count; i++) {
         device_cache_t *target = &DEVICE_CACHE[i];
-        if (target->uuid == 0) break;
+        if (target->uuid == 0) continue;		// free slot
 
         if (count > 0) *ptr++ = ',';
 		int written = snprintf(ptr, buffer_size - (ptr - buffer),
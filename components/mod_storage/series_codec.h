@@ -0,0 +1,162 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+// ============================================================================
+// SERIES CODEC: delta-of-delta timestamps + zigzag varint value deltas
+// ============================================================================
+// series layout: uint32_t timestamp followed by int16_t values (record_t: 4, envelope_t: 13)
+// a fixed interval costs 1 byte for the timestamp, a slow changing value 1 byte
+// 1 minute records: 12 bytes -> ~5 bytes
+// pure C, no ESP dependencies: the same code encodes on the device and decodes anywhere
+
+#define SERIES_CODEC_MAX_VALUES 13
+#define SERIES_CODEC_MAX_SERIES (sizeof(uint32_t) + SERIES_CODEC_MAX_VALUES * sizeof(int16_t))
+#define SERIES_CODEC_MAX_BYTES (5 + 3 * SERIES_CODEC_MAX_VALUES)		// worst case of one series
+
+// state after the last series - a zeroed state starts a new stream
+typedef struct __attribute__((packed)) {
+	uint32_t timestamp;
+	uint32_t delta;
+	int16_t values[SERIES_CODEC_MAX_VALUES];
+} series_codec_t;
+
+static inline int series_codec_values(size_t series_size) {
+	return (series_size - sizeof(uint32_t)) / sizeof(int16_t);
+}
+
+// bytes of the state that matter for series_size: stored after the compressed block headers
+static inline size_t series_codec_state_size(size_t series_size) {
+	return 2 * sizeof(uint32_t) + series_codec_values(series_size) * sizeof(int16_t);
+}
+
+static inline int series_codec_supported(size_t series_size) {
+	return series_size >= sizeof(uint32_t) && series_size <= SERIES_CODEC_MAX_SERIES &&
+			(series_size - sizeof(uint32_t)) % sizeof(int16_t) == 0;
+}
+
+static inline uint32_t zigzag_encode(int32_t value) {
+	return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+static inline int32_t zigzag_decode(uint32_t value) {
+	return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+static inline uint8_t* varint_put(uint8_t *out, uint32_t value) {
+	while (value >= 0x80) {
+		*out++ = (uint8_t)(value | 0x80);
+		value >>= 7;
+	}
+	*out++ = (uint8_t)value;
+	return out;
+}
+
+// returns NULL when the varint is truncated
+static inline const uint8_t* varint_get(const uint8_t *in, const uint8_t *end, uint32_t *value) {
+	uint32_t result = 0;
+	for (int shift = 0; in < end && shift < 35; shift += 7) {
+		uint8_t byte = *in++;
+		result |= (uint32_t)(byte & 0x7F) << shift;
+		if (!(byte & 0x80)) {
+			*value = result;
+			return in;
+		}
+	}
+	return NULL;
+}
+
+//* @brief Encode one series, returns the bytes written (SERIES_CODEC_MAX_BYTES at most)
+// first series of a stream: the timestamp itself, then the delta-of-delta
+// all timestamp math is modulo 2^32 so any uint32_t round-trips
+
+static size_t series_encode_one(series_codec_t *state, const uint8_t *series, int value_count, uint8_t *out) {
+	uint8_t *ptr = out;
+	uint32_t timestamp;
+	memcpy(&timestamp, series, sizeof(timestamp));
+
+	uint32_t delta = state->timestamp ? timestamp - state->timestamp : 0;
+	uint32_t dod = state->timestamp ? delta - state->delta : timestamp;
+	ptr = varint_put(ptr, zigzag_encode((int32_t)dod));
+
+	for (int i = 0; i < value_count; i++) {
+		int16_t value;
+		memcpy(&value, series + sizeof(uint32_t) + i * sizeof(int16_t), sizeof(value));
+		ptr = varint_put(ptr, zigzag_encode((int32_t)value - state->values[i]));
+		state->values[i] = value;
+	}
+
+	state->timestamp = timestamp;
+	state->delta = delta;
+	return ptr - out;
+}
+
+//* @brief Encode up to count series into out, stops at the first series that doesn't fit out_size
+// returns the bytes written, encoded = series encoded (state only advances for those)
+
+static size_t series_encode(
+	series_codec_t *state, const void *series, size_t series_size, int count,
+	uint8_t *out, size_t out_size, int *encoded
+) {
+	const uint8_t *ptr = (const uint8_t*)series;
+	const int value_count = series_codec_values(series_size);
+	uint8_t scratch[SERIES_CODEC_MAX_BYTES];
+	size_t used = 0;
+	int n = 0;
+
+	for (; n < count; n++) {
+		series_codec_t next = *state;
+		size_t len = series_encode_one(&next, ptr + n * series_size, value_count, scratch);
+		if (used + len > out_size) break;
+
+		memcpy(out + used, scratch, len);
+		*state = next;
+		used += len;
+	}
+
+	*encoded = n;
+	return used;
+}
+
+//* @brief Decode up to count series from in, output NULL skips them (state still advances)
+// returns the series decoded, consumed = bytes read from in
+
+static int series_decode(
+	series_codec_t *state, const uint8_t *in, size_t in_size,
+	void *output, size_t series_size, int count, size_t *consumed
+) {
+	uint8_t *out = (uint8_t*)output;
+	const uint8_t *ptr = in;
+	const uint8_t *end = in + in_size;
+	const int value_count = series_codec_values(series_size);
+	int n = 0;
+
+	for (; n < count && ptr < end; n++) {
+		uint32_t raw;
+		const uint8_t *next = varint_get(ptr, end, &raw);
+		if (!next) break;
+
+		uint32_t dod = (uint32_t)zigzag_decode(raw);
+		uint32_t delta = state->timestamp ? state->delta + dod : 0;
+		uint32_t timestamp = state->timestamp ? state->timestamp + delta : dod;
+
+		series_codec_t decoded = { .timestamp = timestamp, .delta = delta };
+		for (int i = 0; i < value_count && next; i++) {
+			next = varint_get(next, end, &raw);
+			decoded.values[i] = (int16_t)(state->values[i] + zigzag_decode(raw));
+		}
+		if (!next) break;		// truncated series
+
+		*state = decoded;
+		ptr = next;
+
+		if (out) {
+			uint8_t *series = out + n * series_size;
+			memcpy(series, &timestamp, sizeof(timestamp));
+			memcpy(series + sizeof(uint32_t), state->values, value_count * sizeof(int16_t));
+		}
+	}
+
+	*consumed = ptr - in;
+	return n;
+}
@@ -1,9 +1,19 @@
+#include <errno.h>
+#include <unistd.h>
+
 #include "esp_log.h"
 #include "esp_vfs_fat.h"
 #include "sdmmc_cmd.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_rom_crc.h"
+
+#include "../lib_sd_log/lib_sd_log.h"
+#include "series_codec.h"
 
 #define RECORD_FILE_BLOCK_SIZE 4096
-#define HEADER_MAGIC 0xCACABABE // File identifier
+#define HEADER_MAGIC 0xCACABABF			// File identifier: extended header (mode, flags, ring, blocks)
+#define HEADER_MAGIC_LEGACY 0xCACABABE		// flat 4KB files of the old writer: preserved1..4 hold garbage
 
 static const char *TAG_RECORD = "#REC";
 
@@ -18,35 +28,577 @@ typedef struct __attribute__((packed)) {
 	uint16_t last_series_count;  	// How many series written
 	uint16_t next_offset;   		// Where to write next (0-4086)
 
-	uint32_t preserved1;
-	uint32_t preserved2;
-	uint32_t preserved3;
-	uint32_t preserved4;
+	uint8_t mode;					// SERIES_MODE_*
+	uint8_t flags;					// SERIES_FLAG_*
+	uint16_t capacity;				// ring: number of series slots
+	uint16_t write_cursor;			// ring: slot of the next write
+	uint16_t block_count;			// segmented: allocated 4KB blocks
+	uint32_t total_count;			// segmented: series written (last_series_count caps at 65535)
+	uint16_t sequence;				// insert count, stamped on compressed blocks
+	uint16_t series_size;			// bytes per series, 0: unknown (files before the field)
 } file_header_t;
 
-#define HEADER_SIZE sizeof(file_header_t)  // 12 bytes
+#define SERIES_MODE_FLAT 0			// append until the block is full
+#define SERIES_MODE_RING 1			// fixed capacity, overwrite the oldest series
+#define SERIES_MODE_SEGMENTED 2		// grows by 4KB blocks, one file per day
+#define SERIES_FLAG_WRAPPED 0x01	// ring: the cursor went around at least once
+#define SERIES_FLAG_COMPRESSED 0x02	// segmented: blocks hold series_codec streams
+#define SERIES_LEGACY_SIZE 12		// compressed files before series_size: 12 byte records
+
+#define HEADER_SIZE sizeof(file_header_t)  // 32 bytes
 #define MAX_DATA_SIZE (RECORD_FILE_BLOCK_SIZE - HEADER_SIZE)
 
+//* @brief Read a legacy header as a flat file of unknown series size
+// the fields after next_offset were preserved1..4, written from an uninitialized stack header
+static inline void series_header_upgrade(file_header_t *header) {
+	if (header->magic != HEADER_MAGIC_LEGACY) return;
+	memset(&header->mode, 0, HEADER_SIZE - offsetof(file_header_t, mode));
+	header->magic = HEADER_MAGIC;
+}
+
+// Segmented file: [header + block directory: 1 sector][series packed over 4KB blocks...]
+// the directory keeps the first timestamp of every block worth of series (4096 / series_size)
+// so range lookups start from memory and the header update stays a single sector write
+#define SERIES_SEGMENT_HEADER_SIZE 512
+#define SERIES_DIR_COUNT ((SERIES_SEGMENT_HEADER_SIZE - HEADER_SIZE) / sizeof(uint32_t))	// 120 blocks
+#define SERIES_BLOCK_SERIES(series_size) (RECORD_FILE_BLOCK_SIZE / (series_size))
+
+// Compressed segmented file: every 4KB block is a self-contained codec stream
+// [series_block_t][encoded series...] - the directory keeps the first timestamp of each block
+// only the codec state of the file's series is stored (series_block_size): 32 bytes for 12 byte series
+typedef struct __attribute__((packed)) {
+	uint16_t count;				// series in the block
+	uint16_t used;				// bytes used, block header included
+	uint32_t base_count;		// series stored in the previous blocks
+	uint16_t sequence;			// header sequence of the last append
+	uint16_t preserved;
+	uint32_t crc;				// crc32 of the encoded series, continued on each append
+	series_codec_t state;		// encoder state after the last series: appends resume from here
+} series_block_t;
+
+#define SERIES_BLOCK_FIXED offsetof(series_block_t, state)
+
+static inline size_t series_block_size(size_t series_size) {
+	return SERIES_BLOCK_FIXED + series_codec_state_size(series_size);
+}
+
+// encode/decode scratch - guarded by the handle cache lock
+static uint8_t series_block_buffer[RECORD_FILE_BLOCK_SIZE];
+
+
+// ============================================================================
+// OPEN HANDLE CACHE
+// ============================================================================
+// why: fopen is ~7.5ms on the SD card, keep the recently used series files open (LRU)
+// the handles share the FATFS max_files pool with the rotate logs and http streaming
+
+#define SERIES_HANDLE_COUNT (SD_MAX_FILES - 3)
+#define SERIES_PATH_LEN 64
+
+typedef struct {
+	FILE *file;
+	uint32_t last_used;				// LRU tick
+	char path[SERIES_PATH_LEN];
+	file_header_t header;			// lazy header (compressed files)
+	uint8_t dirty;					// header is newer than the file
+	uint8_t checked;				// tail recovery done since open
+} series_handle_t;
+
+typedef struct {
+	uint32_t hits;
+	uint32_t misses;
+	uint32_t evictions;
+} series_handle_stats_t;
+
+static series_handle_t SERIES_HANDLES[SERIES_HANDLE_COUNT] = {0};
+static series_handle_stats_t series_handle_stats = {0};
+static uint32_t series_handle_tick = 0;
+
+// handles are shared by the main loop and the http tasks - held from acquire to release
+static SemaphoreHandle_t SERIES_HANDLE_MUTEX = NULL;
+
+void series_handle_init() {
+	if (!SERIES_HANDLE_MUTEX) SERIES_HANDLE_MUTEX = xSemaphoreCreateMutex();
+}
+
+static void series_handle_lock() {
+	if (SERIES_HANDLE_MUTEX) xSemaphoreTake(SERIES_HANDLE_MUTEX, portMAX_DELAY);
+}
+
+void series_handle_release() {
+	if (SERIES_HANDLE_MUTEX) xSemaphoreGive(SERIES_HANDLE_MUTEX);
+}
+
+// fclose commits the FAT entry and the cached sector - a lazy header is written first
+static void series_handle_close(series_handle_t *handle) {
+	if (!handle->file) return;
+	if (handle->dirty) {
+		fseek(handle->file, 0, SEEK_SET);
+		fwrite(&handle->header, 1, HEADER_SIZE, handle->file);
+		handle->dirty = 0;
+	}
+	fclose(handle->file);
+	handle->file = NULL;
+	handle->path[0] = '\0';
+}
+
+//* @brief Get the cached handle of the file or open it - evicting the least recently used
+// create: truncate and create the file ("wb+"), otherwise open the existing file ("rb+")
+// NOTE: requires series_handle_lock, the position of a cached handle is undefined (always fseek)
+
+static FILE* series_handle_get(const char *filename, int create) {
+	series_handle_t *slot = NULL;
+	series_handle_t *lru = &SERIES_HANDLES[0];
+
+	for (int i = 0; i < SERIES_HANDLE_COUNT; i++) {
+		series_handle_t *handle = &SERIES_HANDLES[i];
+
+		if (handle->file && strncmp(handle->path, filename, SERIES_PATH_LEN) == 0) {
+			slot = handle;
+			break;
+		}
+
+		// prefer empty slots, then the least recently used
+		if (!lru->file) continue;
+		if (!handle->file || handle->last_used < lru->last_used) lru = handle;
+	}
+
+	if (slot && !create) {
+		series_handle_stats.hits++;
+		slot->last_used = ++series_handle_tick;
+		return slot->file;
+	}
+
+	series_handle_stats.misses++;
+
+	// recreate the same file
+	if (slot) series_handle_close(slot);
+
+	// open before evicting: a missing file (day, rollup, ETag probes) keeps the live handles
+	const char *mode = create ? "wb+" : "rb+";
+	FILE *file = fopen(filename, mode);		// ~7.5ms
+
+	// the FATFS pool is full: the evicted handle frees its file
+	if (!file && !slot && lru->file && (errno == ENFILE || errno == EMFILE)) {
+		series_handle_stats.evictions++;
+		series_handle_close(lru);
+		file = fopen(filename, mode);
+	}
+	if (!file) return NULL;
+
+	if (!slot) {
+		slot = lru;
+		if (slot->file) series_handle_stats.evictions++;
+		series_handle_close(slot);
+	}
+
+	slot->file = file;
+	slot->last_used = ++series_handle_tick;
+	slot->dirty = 0;
+	slot->checked = create;		// nothing to recover in a new file
+	strncpy(slot->path, filename, SERIES_PATH_LEN - 1);
+	slot->path[SERIES_PATH_LEN - 1] = '\0';
+	return file;
+}
+
+//* @brief Lock the cache and get the handle, returns NULL (unlocked) if the file doesn't exist
+// call series_handle_release when done with the handle
+
+FILE* series_handle_acquire(const char *filename) {
+	series_handle_lock();
+	FILE *file = series_handle_get(filename, 0);
+	if (!file) series_handle_release();
+	return file;
+}
+
+//* @brief Flush and close the cached handles starting with prefix
+// use on day rollover and before remove/rename/direct fopen, "" closes everything
+
+void series_handle_evict(const char *prefix) {
+	size_t len = strlen(prefix);
+	series_handle_lock();
+
+	for (int i = 0; i < SERIES_HANDLE_COUNT; i++) {
+		series_handle_t *handle = &SERIES_HANDLES[i];
+		if (handle->file && strncmp(handle->path, prefix, len) == 0) {
+			series_handle_close(handle);
+		}
+	}
+
+	series_handle_release();
+}
+
+int series_handle_statsStr(char *buffer) {
+	int open = 0;
+	for (int i = 0; i < SERIES_HANDLE_COUNT; i++) {
+		if (SERIES_HANDLES[i].file) open++;
+	}
+
+	series_handle_stats_t *stats = &series_handle_stats;
+	uint32_t total = stats->hits + stats->misses;
+	return sprintf(buffer, "Series handles: %d/%d open, %ld hits, %ld misses (%ld%% hit), %ld evicted\n",
+			open, SERIES_HANDLE_COUNT, stats->hits, stats->misses,
+			total ? stats->hits * 100 / total : 0, stats->evictions);
+}
+
+
+// ============================================================================
+// SLOT ACCESS
+// ============================================================================
+// series are addressed by logical index: 0 = oldest
+// flat files store them in order, ring files start at the write cursor once wrapped
+
+static inline int series_is_ring(const file_header_t *header) {
+	return header->mode == SERIES_MODE_RING && header->capacity > 0;
+}
+
+static inline int series_is_segmented(const file_header_t *header) {
+	return header->mode == SERIES_MODE_SEGMENTED;
+}
+
+// number of series held by the file
+static inline int series_count_of(const file_header_t *header) {
+	return series_is_segmented(header) ? header->total_count : header->last_series_count;
+}
+
+static inline int series_is_compressed(const file_header_t *header) {
+	return series_is_segmented(header) && (header->flags & SERIES_FLAG_COMPRESSED);
+}
+
+// files without series_size accept any size (the caller knows what it wrote)
+static inline int series_size_matches(const file_header_t *header, size_t series_size) {
+	return !header->series_size || header->series_size == series_size;
+}
+
+static inline size_t series_data_offset(const file_header_t *header) {
+	return series_is_segmented(header) ? SERIES_SEGMENT_HEADER_SIZE : HEADER_SIZE;
+}
+
+static inline int series_slot_of(const file_header_t *header, int index) {
+	if (!series_is_ring(header)) return index;
+	int oldest = (header->flags & SERIES_FLAG_WRAPPED) ? header->write_cursor : 0;
+	return (oldest + index) % header->capacity;
+}
+
+//* @brief Read the header of block b, the file is then positioned on its encoded series
+static int series_block_read(FILE *f, int b, size_t series_size, series_block_t *block) {
+	const size_t size = series_block_size(series_size);
+	memset(block, 0, sizeof(*block));
+
+	fseek(f, SERIES_SEGMENT_HEADER_SIZE + b * RECORD_FILE_BLOCK_SIZE, SEEK_SET);
+	if (fread(block, 1, size, f) != size) return 0;
+	return block->used >= size && block->used <= RECORD_FILE_BLOCK_SIZE;
+}
+
+//* @brief Find the block holding the logical index of a compressed file
+// binary search on the base counts: ~log2(120) = 7 block header reads instead of one per block
+static int series_block_of_index(
+	FILE *f, const file_header_t *header, size_t series_size, int index, uint32_t *base_count
+) {
+	int low = 0, high = header->block_count - 1, found = 0;
+	*base_count = 0;
+	while (low <= high) {
+		int mid = low + (high - low) / 2;
+		series_block_t block;
+
+		if (series_block_read(f, mid, series_size, &block) && (uint32_t)index >= block.base_count) {
+			found = mid;
+			*base_count = block.base_count;
+			low = mid + 1;
+		} else {
+			high = mid - 1;
+		}
+	}
+	return found;
+}
+
+//* @brief Decode count series starting at the logical index of a compressed file
+// picks the block by its base count, then decodes from that block start only
+
+static int series_decode_slots(
+	FILE *f, const file_header_t *header, size_t series_size,
+	int index, int count, void *output
+) {
+	uint8_t *out = (uint8_t*)output;
+	int count_read = 0;
+
+	uint32_t base_count;
+	int b = series_block_of_index(f, header, series_size, index, &base_count);
+	index -= base_count;
+
+	for (; b < header->block_count && count_read < count; b++) {
+		series_block_t block;
+		if (!series_block_read(f, b, series_size, &block)) break;
+
+		if (index >= block.count) {
+			index -= block.count;
+			continue;
+		}
+
+		// encoded series follow the block header
+		size_t len = fread(series_block_buffer, 1, block.used - series_block_size(series_size), f);
+		series_codec_t state = {0};
+		size_t consumed;
+
+		series_decode(&state, series_block_buffer, len, NULL, series_size, index, &consumed);
+		count_read += series_decode(&state, series_block_buffer + consumed, len - consumed,
+							out + count_read * series_size, series_size, count - count_read, &consumed);
+		index = 0;
+	}
+	return count_read;
+}
+
+static uint32_t series_timestamp_at(
+	FILE *f, const file_header_t *header, size_t series_size, int index
+) {
+	uint32_t timestamp = 0;
+	if (series_is_compressed(header)) {
+		uint8_t series[SERIES_CODEC_MAX_SERIES];
+		series_decode_slots(f, header, series_size, index, 1, series);
+		memcpy(&timestamp, series, sizeof(timestamp));
+		return timestamp;
+	}
+
+	fseek(f, series_data_offset(header) + series_slot_of(header, index) * series_size, SEEK_SET);
+	fread(&timestamp, 1, sizeof(timestamp), f);
+	return timestamp;
+}
+
+//* @brief Read count series starting at the logical index (oldest first)
+// one fseek + fread (segmented series are contiguous), two when the slice wraps around the ring
+
+static int series_read_slots(
+	FILE *f, const file_header_t *header, size_t series_size,
+	int index, int count, void *output
+) {
+	if (!series_size_matches(header, series_size)) {
+		ESP_LOGE(TAG_RECORD, "series_read_slots SIZE-MISMATCH: %d/%d", series_size, header->series_size);
+		return 0;
+	}
+	if (series_is_compressed(header)) {
+		return series_decode_slots(f, header, series_size, index, count, output);
+	}
+
+	int slot = series_slot_of(header, index);
+	int first_chunk = count;
+	if (series_is_ring(header) && slot + count > header->capacity) {
+		first_chunk = header->capacity - slot;
+	}
+
+	fseek(f, series_data_offset(header) + slot * series_size, SEEK_SET);
+	int count_read = fread(output, series_size, first_chunk, f);
+
+	if (count_read == first_chunk && first_chunk < count) {
+		fseek(f, HEADER_SIZE, SEEK_SET);
+		count_read += fread((uint8_t*)output + first_chunk * series_size,
+							series_size, count - first_chunk, f);
+	}
+	return count_read;
+}
+
+
+// ============================================================================
+// LAZY HEADER
+// ============================================================================
+// compressed files skip the header rewrite (seek 0 + one more sector write) on most inserts:
+// the header stays in the handle and goes to the file every SERIES_HEADER_SYNC_INTERVAL inserts,
+// when a block opens and when the handle closes (day rollover, eviction)
+// the block header (count, used, sequence, crc) is still written and synced on every append:
+// after a power cut the first header read scans forward from the last synced block and
+// recovers every series written since - nothing is held in RAM only
+
+#define SERIES_HEADER_SYNC_INTERVAL 12		// 1 hour of 5 minute inserts
+
+static series_handle_t* series_handle_of(FILE *f) {
+	for (int i = 0; i < SERIES_HANDLE_COUNT; i++) {
+		if (SERIES_HANDLES[i].file == f) return &SERIES_HANDLES[i];
+	}
+	return NULL;
+}
+
+//* @brief Read a block header and check the crc of its series (preallocated garbage fails)
+static int series_block_valid(FILE *f, int b, size_t series_size, series_block_t *block) {
+	if (!series_block_read(f, b, series_size, block)) return 0;
+
+	size_t len = block->used - series_block_size(series_size);
+	if (fread(series_block_buffer, 1, len, f) != len) return 0;
+	return esp_rom_crc32_le(0, series_block_buffer, len) == block->crc;
+}
+
+//* @brief Recover the count and last timestamp of the series appended after the last header sync
+// returns 1 when the header was behind
+
+static int series_header_recover(FILE *f, file_header_t *header) {
+	const char method_name[] = "series_header_recover";
+	if (!series_is_compressed(header)) return 0;
+
+	fseek(f, 0, SEEK_END);
+	long size = ftell(f);
+	int allocated = (size - SERIES_SEGMENT_HEADER_SIZE) / RECORD_FILE_BLOCK_SIZE;
+	if (allocated > (int)SERIES_DIR_COUNT) allocated = SERIES_DIR_COUNT;
+
+	//# Scan from the last synced block, each block must continue the previous one
+	const size_t series_size = header->series_size ? header->series_size : SERIES_LEGACY_SIZE;
+	series_block_t block, last = {0};
+	int last_index = -1;
+	for (int b = header->block_count ? header->block_count - 1 : 0; b < allocated; b++) {
+		if (!series_block_valid(f, b, series_size, &block)) break;
+		if (last_index >= 0 && (
+			block.base_count != last.base_count + last.count ||
+			(int16_t)(block.sequence - last.sequence) <= 0		// uint16_t: wrap safe
+		)) break;
+
+		last = block;
+		last_index = b;
+	}
+
+	if (last_index < 0) return 0;
+	uint32_t total = last.base_count + last.count;
+	if (total <= header->total_count) return 0;
+
+	ESP_LOGW(TAG_RECORD, "%s TAIL-RECOVERED", method_name);
+	printf("- Recovered: %ld -> %ld series, %d blocks\n", header->total_count, total, last_index + 1);
+
+	header->total_count = total;
+	header->last_series_count = (total > UINT16_MAX) ? UINT16_MAX : total;
+	if (header->block_count < last_index + 1) header->block_count = last_index + 1;
+	header->last_timestamp = last.state.timestamp;
+	header->sequence = last.sequence;
+	return 1;
+}
+
+//* @brief Read the header of a cached handle - the lazy copy when it's newer than the file
+// returns 1 when a full header was read
+// NOTE: requires series_handle_lock
+
+int series_header_read(FILE *f, file_header_t *header) {
+	series_handle_t *handle = series_handle_of(f);
+	if (handle && handle->dirty) {
+		*header = handle->header;
+		return 1;
+	}
+
+	fseek(f, 0, SEEK_SET);
+	if (fread(header, 1, HEADER_SIZE, f) != HEADER_SIZE) return 0;
+	series_header_upgrade(header);
+
+	//# First read since open: pick up the series written after the last sync
+	if (handle && !handle->checked) {
+		handle->checked = 1;
+		if (header->magic == HEADER_MAGIC && series_header_recover(f, header)) {
+			handle->header = *header;
+			handle->dirty = 1;
+		}
+	}
+	return 1;
+}
+
+//* @brief Read the header of a series file without taking a handle (ETags): no open, no eviction
+// the lazy header of a cached handle when it's newer than the file, a read-only fopen otherwise
+// returns 1 when a full header was read
+
+int series_header_peek(const char *filename, file_header_t *header) {
+	series_handle_lock();
+	for (int i = 0; i < SERIES_HANDLE_COUNT; i++) {
+		series_handle_t *handle = &SERIES_HANDLES[i];
+		if (handle->file && handle->dirty && strncmp(handle->path, filename, SERIES_PATH_LEN) == 0) {
+			*header = handle->header;
+			series_handle_release();
+			return 1;
+		}
+	}
+	series_handle_release();
+
+	FILE *f = fopen(filename, "rb");
+	if (!f) return 0;
+	int read = fread(header, 1, HEADER_SIZE, f) == HEADER_SIZE;
+	fclose(f);
+	if (read) series_header_upgrade(header);
+	return read;
+}
+
+//* @brief Commit the file to the card: data, FAT chain and the directory entry size
+// fflush only hands the data to FATFS, the entry size is written on fsync / fclose -
+// a power loss keeps the file as of its last sync instead of its last fclose (a day of growth)
+static void series_file_sync(FILE *f) {
+	fflush(f);
+	fsync(fileno(f));		// ~2ms: the directory sector
+}
+
+//* @brief Write the header to the file or keep it in the handle (lazy)
+static void series_header_write(FILE *f, const file_header_t *header, int lazy) {
+	series_handle_t *handle = series_handle_of(f);
+	if (lazy && handle) {
+		handle->header = *header;
+		handle->dirty = 1;
+		return;
+	}
+
+	fseek(f, 0, SEEK_SET);							// ~150us
+	fwrite(header, 1, HEADER_SIZE, f);				// ~30us
+	if (handle) handle->dirty = 0;
+}
+
 
 // ============================================================================
 // CREATE/INITIALIZE FILE
 // ============================================================================
 
 void series_get_header(const char* filename, file_header_t *header) {
-	FILE* f = fopen(filename, "rb");
-	fread(header, 1, HEADER_SIZE, f);
-	fclose(f);
+	FILE* f = series_handle_acquire(filename);
+	if (!f) return;
+	series_header_read(f, header);
+	series_handle_release();
 }
 
-FILE* series_file_ensure(const char* filename, file_header_t *header) {
+// Write the header and pre-allocate the data area
+static void series_file_format(FILE *file, file_header_t *header, size_t data_size) {
+	fseek(file, 0, SEEK_SET);
+	fwrite(header, 1, HEADER_SIZE, file);
+
+    // Pre-allocate fixed size efficiently
+    uint8_t zero[512] = {0};  // Buffer for faster zero-fill
+    size_t remaining = data_size;
+    while (remaining > 0) {
+        size_t chunk = (remaining > sizeof(zero)) ? sizeof(zero) : remaining;
+        fwrite(zero, 1, chunk, file);
+        remaining -= chunk;
+    }
+}
+
+//* @brief Create an empty segmented series file: header + block directory, no data blocks yet
+// NOTE: requires series_handle_lock
+static FILE* series_segment_create(
+	const char* filename, file_header_t *header, size_t series_size, uint8_t flags
+) {
+	FILE* file = series_handle_get(filename, 1);
+	if (!file) return NULL;
+
+	memset(header, 0, HEADER_SIZE);
+	header->magic = HEADER_MAGIC;
+	header->mode = SERIES_MODE_SEGMENTED;
+	header->flags = flags;
+	header->series_size = series_size;
+	series_file_format(file, header, SERIES_SEGMENT_HEADER_SIZE - HEADER_SIZE);
+	return file;
+}
+
+//* @brief Get the cached handle of a valid series file, create it otherwise
+// returns with the handle cache locked - call series_handle_release when done
+// mode: SERIES_MODE_FLAT or SERIES_MODE_SEGMENTED for new files (flags: SERIES_FLAG_COMPRESSED)
+
+FILE* series_file_ensure(
+	const char* filename, file_header_t *header, size_t series_size, int mode, uint8_t flags
+) {
 	const char method_name[] = "series_file_start";
+	series_handle_lock();
 
 	// First check if file already exists and is valid
-	FILE* file = fopen(filename, "rb+");			// ~7.5ms
+	FILE* file = series_handle_get(filename, 0);		// ~7.5ms on miss
 
 	if (file) {
 		// File exists - check if it's already a valid fixed file
-		if (fread(header, 1, HEADER_SIZE, file) == HEADER_SIZE &&
+		if (series_header_read(file, header) &&
 			header->magic == HEADER_MAGIC
 		) {
 			// Valid file already exists!
@@ -56,88 +608,290 @@ FILE* series_file_ensure(const char* filename, file_header_t *header) {
 			return file;
 		}
 
-        // Invalid file - close and recreate
-        fclose(file);
+		// Invalid file - recreate
 		ESP_LOGI(TAG_RECORD, "%s INVALID-FOUND %s. Recreating...", method_name, filename);
 	}
 
 	// Create the file
-	file = fopen(filename, "wb+");
+	if (mode == SERIES_MODE_SEGMENTED) {
+		file = series_segment_create(filename, header, series_size, flags);
+	}
+	else if ((file = series_handle_get(filename, 1))) {
+		// Write header
+		memset(header, 0, HEADER_SIZE);
+		header->magic = HEADER_MAGIC;
+		header->mode = SERIES_MODE_FLAT;
+		header->series_size = series_size;
+		series_file_format(file, header, RECORD_FILE_BLOCK_SIZE - HEADER_SIZE);
+	}
+
 	if (!file) {
+		series_handle_release();
 		ESP_LOGE(TAG_RECORD, "%s CANNOT-CREATE", method_name);
 		printf("- Failed to create: %s\n", filename);
 		return NULL;
 	}
 
-	// Write header
-	header->magic = HEADER_MAGIC;
-	header->start_timestamp = 0;
-	header->last_timestamp = 0;
-	header->next_offset = 0;
-	header->last_series_count = 0;
-	fwrite(header, 1, HEADER_SIZE, file);
-
-    // Pre-allocate fixed size efficiently
-    uint8_t zero[512] = {0};  // Buffer for faster zero-fill
-    size_t remaining = RECORD_FILE_BLOCK_SIZE - HEADER_SIZE;
-    while (remaining > 0) {
-        size_t chunk = (remaining > sizeof(zero)) ? sizeof(zero) : remaining;
-        fwrite(zero, 1, chunk, file);
-        remaining -= chunk;
-    }
-
-	// fclose(f);
 	ESP_LOGI(TAG_RECORD, "%s LOG-CREATED", method_name);
-	printf("- File created: %s (%d bytes)\n", filename, RECORD_FILE_BLOCK_SIZE);
+	printf("- File created: %s (mode %d, %d byte series)\n", filename, mode, series_size);
 
 	// return 1;
 	return file;
 }
 
+//* @brief Create a ring series file of capacity slots, keeps an existing ring of the same capacity
+// series_batch_insert then overwrites the oldest series instead of filling up
+
+int series_ring_create(const char* filename, size_t series_size, uint16_t capacity) {
+	const char method_name[] = "series_ring_create";
+	file_header_t header;
+	series_handle_lock();
+
+	FILE* file = series_handle_get(filename, 0);
+	if (file) {
+		if (series_header_read(file, &header) &&
+			header.magic == HEADER_MAGIC &&
+			series_is_ring(&header) && header.capacity == capacity &&
+			series_size_matches(&header, series_size)
+		) {
+			series_handle_release();
+			return 1;
+		}
+		ESP_LOGI(TAG_RECORD, "%s INVALID-FOUND %s. Recreating...", method_name, filename);
+	}
+
+	file = series_handle_get(filename, 1);
+	if (!file) {
+		series_handle_release();
+		ESP_LOGE(TAG_RECORD, "%s CANNOT-CREATE", method_name);
+		printf("- Failed to create: %s\n", filename);
+		return 0;
+	}
+
+	memset(&header, 0, HEADER_SIZE);
+	header.magic = HEADER_MAGIC;
+	header.mode = SERIES_MODE_RING;
+	header.capacity = capacity;
+	header.series_size = series_size;
+	series_file_format(file, &header, capacity * series_size);
+	series_file_sync(file);
+	series_handle_release();
+
+	ESP_LOGI(TAG_RECORD, "%s RING-CREATED", method_name);
+	printf("- Ring created: %s (%d slots, %d bytes)\n",
+			filename, capacity, HEADER_SIZE + capacity * series_size);
+	return 1;
+}
+
 
 // ============================================================================
 // WRITE MULTIPLE RECORD
 // ============================================================================
+
+//* @brief Write at the ring cursor, wrapping to the first slot - only the newest capacity series are kept
+static size_t series_ring_write(
+	FILE *f, file_header_t *header, const void *series, size_t series_size, int count
+) {
+	const uint8_t *ptr = (const uint8_t*)series;
+	const int capacity = header->capacity;
+
+	if (count > capacity) {
+		ptr += (count - capacity) * series_size;
+		count = capacity;
+	}
+
+	int cursor = header->write_cursor;
+	int first_chunk = capacity - cursor;
+	if (first_chunk > count) first_chunk = count;
+
+	fseek(f, HEADER_SIZE + cursor * series_size, SEEK_SET);
+	size_t written = fwrite(ptr, series_size, first_chunk, f);
+
+	if (written == first_chunk && first_chunk < count) {
+		fseek(f, HEADER_SIZE, SEEK_SET);
+		written += fwrite(ptr + first_chunk * series_size, series_size, count - first_chunk, f);
+	}
+
+	cursor += written;
+	if (cursor >= capacity) {
+		cursor -= capacity;
+		header->flags |= SERIES_FLAG_WRAPPED;
+	}
+	header->write_cursor = cursor;
+
+	int total = header->last_series_count + written;
+	header->last_series_count = (total > capacity) ? capacity : total;
+	return written;
+}
+
+//* @brief Append to a segmented file, growing it by whole 4KB blocks
+// growing seeks past the end and writes the last byte: FAT allocates the clusters without a zero-fill
+// the unused tail of a block is never read (total_count bounds every read)
+
+static void series_segment_grow(FILE *f, file_header_t *header, uint16_t blocks) {
+	if (blocks <= header->block_count) return;
+	fseek(f, SERIES_SEGMENT_HEADER_SIZE + blocks * RECORD_FILE_BLOCK_SIZE - 1, SEEK_SET);
+	fputc(0, f);
+	header->block_count = blocks;
+}
+
+static size_t series_segment_write(
+	FILE *f, file_header_t *header, const void *series, size_t series_size, int count
+) {
+	const uint8_t *ptr = (const uint8_t*)series;
+	const uint32_t per_block = SERIES_BLOCK_SERIES(series_size);
+	const uint32_t total = header->total_count;
+
+	//# Check if the block directory is full
+	if (total + count > SERIES_DIR_COUNT * per_block) return 0;
+
+	//# Pre-allocate the blocks
+	size_t data_end = (total + count) * series_size;
+	series_segment_grow(f, header, (data_end + RECORD_FILE_BLOCK_SIZE - 1) / RECORD_FILE_BLOCK_SIZE);
+
+	//# Write the series
+	fseek(f, SERIES_SEGMENT_HEADER_SIZE + total * series_size, SEEK_SET);
+	size_t written = fwrite(series, series_size, count, f);
+
+	//# Block directory: first timestamp of each block started by this batch
+	uint32_t index = (total + per_block - 1) / per_block * per_block;
+	for (; index < total + written; index += per_block) {
+		uint32_t timestamp = *(const uint32_t*)(ptr + (index - total) * series_size);
+		fseek(f, HEADER_SIZE + (index / per_block) * sizeof(uint32_t), SEEK_SET);
+		fwrite(&timestamp, 1, sizeof(timestamp), f);
+	}
+
+	header->total_count = total + written;
+	header->last_series_count = (header->total_count > UINT16_MAX) ? UINT16_MAX : header->total_count;
+	return written;
+}
+
+//* @brief Encode and append to the last block of a compressed file, opening new blocks when full
+// the block header keeps the encoder state: an append never reads the encoded series back
+
+static size_t series_compressed_write(
+	FILE *f, file_header_t *header, const void *series, size_t series_size, int count
+) {
+	const uint8_t *ptr = (const uint8_t*)series;
+	int block_index = header->block_count - 1;
+	series_block_t block = {0};
+	int written = 0;
+
+	if (!series_codec_supported(series_size)) return 0;
+
+	const size_t block_size = series_block_size(series_size);
+
+	//# Resume the last block
+	if (block_index >= 0) {
+		series_block_read(f, block_index, series_size, &block);
+	}
+
+	while (written < count) {
+		int encoded = 0;
+		size_t len = 0;
+		if (block_index >= 0) {
+			len = series_encode(&block.state, ptr + written * series_size, series_size,
+						count - written, series_block_buffer, RECORD_FILE_BLOCK_SIZE - block.used, &encoded);
+		}
+
+		//# Block full: start a fresh stream in a new block
+		if (!encoded) {
+			if (block_index + 1 >= (int)SERIES_DIR_COUNT) break;
+			uint32_t base_count = block.base_count + block.count;
+			block_index++;
+			memset(&block, 0, sizeof(block));
+			block.used = block_size;
+			block.base_count = base_count;
+			series_segment_grow(f, header, block_index + 1);
+			continue;
+		}
+
+		//# Block directory: first timestamp of the block
+		if (block.count == 0) {
+			fseek(f, HEADER_SIZE + block_index * sizeof(uint32_t), SEEK_SET);
+			fwrite(ptr + written * series_size, 1, sizeof(uint32_t), f);
+		}
+
+		//# Append the encoded series then the block header
+		size_t block_offset = SERIES_SEGMENT_HEADER_SIZE + block_index * RECORD_FILE_BLOCK_SIZE;
+		fseek(f, block_offset + block.used, SEEK_SET);
+		if (fwrite(series_block_buffer, 1, len, f) != len) break;
+
+		block.count += encoded;
+		block.used += len;
+		block.sequence = header->sequence;
+		block.crc = esp_rom_crc32_le(block.crc, series_block_buffer, len);
+		fseek(f, block_offset, SEEK_SET);
+		fwrite(&block, 1, block_size, f);
+		written += encoded;
+	}
+
+	header->total_count += written;
+	header->last_series_count = (header->total_count > UINT16_MAX) ? UINT16_MAX : header->total_count;
+	return written;
+}
+
 // assume at least one record is always inserted
+// returns the next_offset (flat) or the bytes held by the ring/segmented file, 0 on failure
 
-int series_batch_insert(
+static int series_insert(
 	const char* filename, file_header_t *output_header,
-	const void *series, size_t series_size, int count
+	const void *series, size_t series_size, int count, int mode, uint8_t flags
 ) {
 	const char method_name[] = "series_batch_insert";
 
 	file_header_t current_header;
-	FILE* f = series_file_ensure(filename, &current_header);
+	FILE* f = series_file_ensure(filename, &current_header, series_size, mode, flags);
 	if (!f) return 0;
 
-	// Check capacity
-	size_t total_bytes = series_size * count;
-	size_t write_pos = HEADER_SIZE + current_header.next_offset;
-
-	//# Check if file is full
-	if (total_bytes + current_header.next_offset > RECORD_FILE_BLOCK_SIZE) {
-		// File is full
-		fclose(f);
-		ESP_LOGE(TAG_RECORD, "%s RECORD-FULL", method_name);
-		printf("- File full: %s\n", filename);
+	if (!series_size_matches(&current_header, series_size)) {
+		series_handle_release();
+		ESP_LOGE(TAG_RECORD, "%s SIZE-MISMATCH", method_name);
+		printf("- %s holds %d byte series, not %d\n", filename, current_header.series_size, series_size);
 		return 0;
 	}
 
-	// // Handle wrap-around if needed
-	// if (output_header->next_offset + total_bytes > MAX_DATA_SIZE) {
-	//     // Wrap to beginning (circular buffer)
-	//     output_header->next_offset = 0;
-	//     write_pos = HEADER_SIZE;
-	//     output_header->series_count = 0;  // Reset count on wrap
-	// }
+	const int is_ring = series_is_ring(&current_header);
+	const int is_segmented = series_is_segmented(&current_header);
+	const uint16_t block_count = current_header.block_count;
+	size_t written;
 
-	// Write the series
-	fseek(f, write_pos, SEEK_SET);							// ~200us
-	size_t written = fwrite(series, series_size, count, f);	// ~75us
+	current_header.sequence++;
+
+	if (is_ring) {
+		//# Ring: wrap-around at the cursor, never full
+		written = series_ring_write(f, &current_header, series, series_size, count);
+	}
+	else if (series_is_compressed(&current_header)) {
+		//# Compressed: encode into the blocks, full when the block directory is
+		written = series_compressed_write(f, &current_header, series, series_size, count);
+	}
+	else if (is_segmented) {
+		//# Segmented: append, full when the block directory is
+		written = series_segment_write(f, &current_header, series, series_size, count);
+	}
+	else {
+		// Check capacity
+		size_t total_bytes = series_size * count;
+		size_t write_pos = HEADER_SIZE + current_header.next_offset;
+
+		//# Check if file is full
+		if (total_bytes + current_header.next_offset > RECORD_FILE_BLOCK_SIZE) {
+			// File is full
+			series_handle_release();
+			ESP_LOGE(TAG_RECORD, "%s RECORD-FULL", method_name);
+			printf("- File full: %s\n", filename);
+			return 0;
+		}
+
+		// Write the series
+		fseek(f, write_pos, SEEK_SET);							// ~200us
+		written = fwrite(series, series_size, count, f);		// ~75us
+	}
 
 	if (written == 0) {
 		// Complete failure
-		fclose(f);
+		series_handle_release();
 		ESP_LOGE(TAG_RECORD, "%s WRITE-FAILED 0/%d series written",
 				method_name, count);
 		return 0;
@@ -149,22 +903,31 @@ int series_batch_insert(
 	uint32_t last_timestamp = *(const uint32_t*)(ptr + series_size * (count - 1));
 
 	//# Start timestamps
-	if (current_header.start_timestamp == 0) {
+	if (is_ring && (current_header.flags & SERIES_FLAG_WRAPPED)) {
+		// the oldest series moves with the cursor
+		current_header.start_timestamp = series_timestamp_at(f, &current_header, series_size, 0);
+	}
+	else if (current_header.start_timestamp == 0) {
 		current_header.start_timestamp = start_timestamp;
 	}
 	//# Last timestamp
 	current_header.last_timestamp = last_timestamp;
 
 	//# Update headers
-	size_t actual_bytes = written * series_size;
-	current_header.next_offset += actual_bytes;
-	current_header.last_series_count += (uint32_t)written;
+	if (!is_ring && !is_segmented) {
+		size_t actual_bytes = written * series_size;
+		current_header.next_offset += actual_bytes;
+		current_header.last_series_count += (uint32_t)written;
+	}
 	*output_header = current_header;
 
-	//# Write back updated header
-	fseek(f, 0, SEEK_SET);							// ~150us
-	fwrite(&current_header, 1, HEADER_SIZE, f);		// ~30us
-	fclose(f);
+	//# Write back updated header - compressed files sync it every interval or on a new block
+	int lazy = series_is_compressed(&current_header) &&
+				current_header.block_count == block_count &&
+				current_header.sequence % SERIES_HEADER_SYNC_INTERVAL;
+	series_header_write(f, &current_header, lazy);
+	series_file_sync(f);			// the series and the block header reach the card on every insert
+	series_handle_release();
 
 	ESP_LOGE(TAG_RECORD, "%s INSERT-RECORDS", method_name);
 	printf("- Inserted: %d/%d series (total %d, next_offset %d)\n",
@@ -172,9 +935,37 @@ int series_batch_insert(
 	RTC_printTimeRange(method_name, current_header.start_timestamp,
 						current_header.last_timestamp, TIME_OFFSET);
 
+	if (is_ring) return current_header.last_series_count * series_size;
+	if (is_segmented) return current_header.total_count * series_size;
 	return current_header.next_offset;
 }
 
+// Insert into a flat 4KB file (or an existing ring)
+int series_batch_insert(
+	const char* filename, file_header_t *output_header,
+	const void *series, size_t series_size, int count
+) {
+	return series_insert(filename, output_header, series, series_size, count, SERIES_MODE_FLAT, 0);
+}
+
+// Insert into a segmented file - created on first insert
+int series_segment_insert(
+	const char* filename, file_header_t *output_header,
+	const void *series, size_t series_size, int count
+) {
+	return series_insert(filename, output_header, series, series_size, count, SERIES_MODE_SEGMENTED, 0);
+}
+
+// Insert into a compressed segmented file - created on first insert
+// series: uint32_t timestamp + int16_t values (series_codec_supported)
+int series_compressed_insert(
+	const char* filename, file_header_t *output_header,
+	const void *series, size_t series_size, int count
+) {
+	return series_insert(filename, output_header, series, series_size, count,
+						SERIES_MODE_SEGMENTED, SERIES_FLAG_COMPRESSED);
+}
+
 
 // ============================================================================
 // READ MULTIPLE RECORD
@@ -187,20 +978,19 @@ int series_file_read_start(
 ) {
 	const char method_name[] = "series_file_read_start";
 
-	FILE* file = fopen(filename, "rb");
+	FILE* file = series_handle_acquire(filename);
 	if (!file) {
 		ESP_LOGE(TAG_RECORD, "%s NOT-FOUND", method_name);
 		printf("- File not found: %s\n", filename);
 		return 0;
 	}
-
 	// Read and validate current header
 	file_header_t header;
-	fread(&header, 1, HEADER_SIZE, file);
+	series_header_read(file, &header);
 
 	if (header.magic != HEADER_MAGIC) {
 		ESP_LOGE(TAG_RECORD, "%s INVALID-HEADER", method_name);
-		fclose(file);
+		series_handle_release();
 		return 0;
 	}
 
@@ -209,13 +999,17 @@ int series_file_read_start(
 		ESP_LOGE(TAG_RECORD, "%s RANGE-OUTBOUND", method_name);
 		printf("- Outbound: header start_ts %ld, input ts %ld\n",
 				header.last_timestamp, timestamp);
-		fclose(file);
+		series_handle_release();
 		return 0;
 	}
 
-	fseek(file, HEADER_SIZE, SEEK_SET);
-	int count = fread(output, series_size, series_count, file);
-	fclose(file);
+	int target_count = series_count;
+	if (series_count_of(&header) < series_count) {
+		target_count = series_count_of(&header);
+	}
+
+	int count = series_read_slots(file, &header, series_size, 0, target_count, output);
+	series_handle_release();
 
 	ESP_LOGI(TAG_RECORD, "%s READ-RECORDS", method_name);
 	printf("- Read: %d/%d series\n", count, series_count);
@@ -232,20 +1026,19 @@ int series_file_read_latest(
 ) {
 	const char method_name[] = "series_file_read_latest";
 
-	FILE* file = fopen(filename, "rb");
+	FILE* file = series_handle_acquire(filename);
 	if (!file) {
 		ESP_LOGE(TAG_RECORD, "%s NOT-FOUND", method_name);
 		printf("- File not found: %s\n", filename);
 		return 0;
 	}
-
 	//# Read and validate current header
 	file_header_t header;
-	fread(&header, 1, HEADER_SIZE, file);
+	series_header_read(file, &header);
 
 	if (header.magic != HEADER_MAGIC) {
 		ESP_LOGE(TAG_RECORD, "%s INVALID-HEADER", method_name);
-		fclose(file);
+		series_handle_release();
 		return 0;
 	}
 
@@ -259,19 +1052,20 @@ int series_file_read_latest(
 		ESP_LOGE(TAG_RECORD, "%s RANGE-OUTBOUND", method_name);
 		printf("- Outbound: input_ts (%s) - last_ts (%s)\n", input_ts, last_ts);
 		RTC_printTimeRange(method_name, header.start_timestamp, header.last_timestamp, TIME_OFFSET);
-		fclose(file);
+		series_handle_release();
 		return 0;
 	}
 
+	int total = series_count_of(&header);
 	int target_count = requested_count;
-	if (header.last_series_count < requested_count) {
-		target_count = header.last_series_count;
+	if (total < requested_count) {
+		target_count = total;
 	}
 
-	//# seek by n requested count records before the next offset
-	fseek(file, HEADER_SIZE + header.next_offset - (target_count * series_size), SEEK_SET);
-	int count = fread(output, series_size, requested_count, file);
-	fclose(file);
+	//# seek by n requested count records before the latest (the write cursor for rings)
+	int count = series_read_slots(file, &header, series_size,
+					total - target_count, target_count, output);
+	series_handle_release();
 
 	ESP_LOGW(TAG_RECORD, "%s READ-RECORDS", method_name);
 	printf("- Read: %d/%d(max) series, Total Count: %d, next_offset: %d\n",
@@ -288,40 +1082,190 @@ int series_file_read_all(
 ) {
 	const char method_name[] = "series_file_read_all";
 
-	FILE* file = fopen(filename, "rb");
+	FILE* file = series_handle_acquire(filename);
 	if (!file) {
 		ESP_LOGE(TAG_RECORD, "%s NOT-FOUND", method_name);
 		printf("- File not found: %s\n", filename);
 		return 0;
 	}
-
 	// Read and validate current header
-	fread(header, 1, HEADER_SIZE, file);
+	series_header_read(file, header);
 	if (header->magic != HEADER_MAGIC) {
 		ESP_LOGE(TAG_RECORD, "%s INVALID-HEADER", method_name);
-		fclose(file);
+		series_handle_release();
 		return 0;
 	}
 
 	// Determine how many series to read
-	int count_to_read = header->last_series_count;
+	int count_to_read = series_count_of(header);
 	if (count_to_read > series_count) count_to_read = series_count;
 
 	if (count_to_read == 0) {
 		ESP_LOGI(TAG_RECORD, "%s NO-RECORD found", method_name);
-        fclose(file);
-        return 0;  // No series to read
+		series_handle_release();
+		return 0;  // No series to read
     }
 
-	// Skip header and read all series in one go
-	fseek(file, HEADER_SIZE, SEEK_SET);
-	int count = fread(output, series_size, count_to_read, file);
-	fclose(file);
+	// Skip header and read all series in one go (two for a wrapped ring)
+	int count = series_read_slots(file, header, series_size, 0, count_to_read, output);
+	series_handle_release();
 	ESP_LOGI(TAG_RECORD, "%s READ-RECORDS: %d/%d", method_name, count, count_to_read);
 
 	return count;
 }
 
+// ============================================================================
+// RANGE QUERY
+// ============================================================================
+// records are appended in time order: binary search the timestamps instead of reading the file
+// ~log2(340) = 9 timestamp probes, then one bounded read of the matching slice
+// rings are searched by logical index, so the wrapped halves read as one sorted array
+
+//* @brief First index in [low, high) with timestamp >= target (or > target when after = 1)
+static int series_search_index(
+	FILE *f, const file_header_t *header, size_t series_size,
+	int low, int high, uint32_t target, int after
+) {
+	while (low < high) {
+		int mid = low + (high - low) / 2;
+		uint32_t timestamp = series_timestamp_at(f, header, series_size, mid);
+
+		if (timestamp < target || (after && timestamp == target)) {
+			low = mid + 1;
+		} else {
+			high = mid;
+		}
+	}
+	return low;
+}
+
+//* @brief Find the block of t_start using the directory timestamps
+// last block starting before t_start: the first match is in it or opens the next one
+static int series_directory_block(FILE *f, int blocks, uint32_t t_start) {
+	static uint32_t directory[SERIES_DIR_COUNT];		// guarded by the handle cache lock
+
+	fseek(f, HEADER_SIZE, SEEK_SET);
+	blocks = fread(directory, sizeof(uint32_t), blocks, f);
+
+	int block = 0;
+	while (block + 1 < blocks && directory[block + 1] < t_start) block++;
+	return block;
+}
+
+//* @brief Limit the search for t_start to one block
+static void series_directory_bounds(
+	FILE *f, const file_header_t *header, size_t series_size,
+	uint32_t t_start, int *low, int *high
+) {
+	const int per_block = SERIES_BLOCK_SERIES(series_size);
+	const int total = series_count_of(header);
+	int block = series_directory_block(f, (total + per_block - 1) / per_block, t_start);
+
+	*low = block * per_block;
+	*high = (block + 1) * per_block;
+	if (*high > total) *high = total;
+}
+
+//* @brief Compressed files: decode forward from the block of t_start until t_end
+static int series_decode_query(
+	FILE *f, const file_header_t *header, size_t series_size,
+	uint32_t t_start, uint32_t t_end, void *output, int max_count
+) {
+	uint8_t *out = (uint8_t*)output;
+	uint8_t series[SERIES_CODEC_MAX_SERIES];
+	int count = 0;
+
+	int b = series_directory_block(f, header->block_count, t_start);
+	for (; b < header->block_count && count < max_count; b++) {
+		series_block_t block;
+		if (!series_block_read(f, b, series_size, &block)) break;
+
+		size_t len = fread(series_block_buffer, 1, block.used - series_block_size(series_size), f);
+		const uint8_t *ptr = series_block_buffer;
+		series_codec_t state = {0};
+		size_t consumed;
+
+		for (int i = 0; i < block.count && count < max_count; i++) {
+			if (!series_decode(&state, ptr, len, series, series_size, 1, &consumed)) break;
+			ptr += consumed;
+			len -= consumed;
+
+			if (state.timestamp > t_end) return count;
+			if (state.timestamp < t_start) continue;
+			memcpy(out + count * series_size, series, series_size);
+			count++;
+		}
+	}
+	return count;
+}
+
+//* @brief Read the records with t_start <= timestamp <= t_end, up to max_count (earliest first)
+// returns the number of records read
+
+int series_file_query(
+	const char* filename, uint32_t t_start, uint32_t t_end,
+	void* output, size_t series_size, int max_count
+) {
+	const char method_name[] = "series_file_query";
+
+	FILE* file = series_handle_acquire(filename);
+	if (!file) {
+		ESP_LOGE(TAG_RECORD, "%s NOT-FOUND", method_name);
+		printf("- File not found: %s\n", filename);
+		return 0;
+	}
+	//# Read and validate current header
+	file_header_t header;
+	series_header_read(file, &header);
+
+	if (header.magic != HEADER_MAGIC || !series_size_matches(&header, series_size)) {
+		ESP_LOGE(TAG_RECORD, "%s INVALID-HEADER", method_name);
+		series_handle_release();
+		return 0;
+	}
+
+	//# Skip files that don't overlap the range
+	int total = series_count_of(&header);
+	if (total == 0 ||
+		header.start_timestamp > t_end || header.last_timestamp < t_start
+	) {
+		series_handle_release();
+		return 0;
+	}
+
+	//# Compressed: no random access, decode forward from the directory block
+	if (series_is_compressed(&header)) {
+		int count = series_decode_query(file, &header, series_size, t_start, t_end, output, max_count);
+		series_handle_release();
+
+		ESP_LOGI(TAG_RECORD, "%s READ-RECORDS", method_name);
+		printf("- Read: %d series (compressed) of %d\n", count, total);
+		return count;
+	}
+
+	//# Narrow down with the block directory (segmented)
+	int low = 0, high = total;
+	if (series_is_segmented(&header)) {
+		series_directory_bounds(file, &header, series_size, t_start, &low, &high);
+	}
+
+	//# Find the slice
+	int first = series_search_index(file, &header, series_size, low, high, t_start, 0);
+	int last = series_search_index(file, &header, series_size, first, total, t_end, 1);
+
+	int count = last - first;
+	if (count > max_count) count = max_count;
+
+	if (count > 0) {
+		count = series_read_slots(file, &header, series_size, first, count, output);
+	}
+	series_handle_release();
+
+	ESP_LOGI(TAG_RECORD, "%s READ-RECORDS", method_name);
+	printf("- Read: %d series [%d, %d) of %d\n", count, first, last, total);
+	return count;
+}
+
 // ============================================================================
 // READ SPECIFIC RECORD
 // ============================================================================
@@ -331,29 +1275,26 @@ int series_file_read_at(
 ) {
 	const char method_name[] = "series_file_read_at";
 
-	FILE* f = fopen(filename, "rb");
+	FILE* f = series_handle_acquire(filename);
 	if (!f) {
 		ESP_LOGE(TAG_RECORD, "%s NOT-FOUND", method_name);
 		printf("- File not found: %s\n", filename);
 		return 0;
 	}
-
 	// Read header
 	file_header_t header;
-	fread(&header, 1, HEADER_SIZE, f);
+	series_header_read(f, &header);
 
 	// Validate index
-	if (record_index < 0 || record_index >= header.last_series_count) {
-		fclose(f);
+	if (record_index < 0 || record_index >= series_count_of(&header)) {
+		series_handle_release();
 		return 0;
 	}
 
-	// Calculate position: header + (index * series_size) & Read the record
-	size_t read_pos = HEADER_SIZE + (record_index * series_size);
-	fseek(f, read_pos, SEEK_SET);
-	int result = fread(output, 1, series_size, f);
-	fclose(f);
-	return (result == series_size);
+	// Calculate position: header + (slot * series_size) & Read the record
+	int result = series_read_slots(f, &header, series_size, record_index, 1, output);
+	series_handle_release();
+	return result;
 }
 
 
@@ -363,29 +1304,27 @@ int series_file_read_at(
 
 int series_file_read_last(const char* filename, void* output, size_t series_size) {
 	const char method_name[] = "series_file_read_last";
-	FILE* f = fopen(filename, "rb");
+	FILE* f = series_handle_acquire(filename);
 	if (!f) {
 		ESP_LOGE(TAG_RECORD, "%s NOT-FOUND", method_name);
 		printf("- File not found: %s\n", filename);
 		return 0;
 	}
-
 	// Read header
 	file_header_t header;
-	fread(&header, 1, HEADER_SIZE, f);
+	series_header_read(f, &header);
 
 	// Check if any series exist
-	if (header.last_series_count == 0) {
-		fclose(f);
+	if (series_count_of(&header) == 0) {
+		series_handle_release();
 		return 0;
 	}
 
-	// Last record is at: header + next_offset - series_size
-	size_t last_pos = HEADER_SIZE + header.next_offset - series_size;
-	fseek(f, last_pos, SEEK_SET);
-	int result = fread(output, 1, series_size, f);
-	fclose(f);
-	return (result == series_size);
+	// Last record is before the next_offset (the write cursor for rings)
+	int result = series_read_slots(f, &header, series_size,
+						series_count_of(&header) - 1, 1, output);
+	series_handle_release();
+	return result;
 }
 
 
@@ -395,21 +1334,39 @@ int series_file_read_last(const char* filename, void* output, size_t series_size
 
 void series_file_status(const char* filename, size_t series_size) {
 	const char method_name[] = "series_file_status";
-	FILE* f = fopen(filename, "rb");
+	FILE* f = series_handle_acquire(filename);
 	if (!f) {
 		ESP_LOGE(TAG_RECORD, "%s NOT-FOUND", method_name);
 		printf("- File not found: %s\n", filename);
 		return;
 	}
-
 	file_header_t header;
-	fread(&header, 1, HEADER_SIZE, f);
-	fclose(f);
+	series_header_read(f, &header);
+	series_handle_release();
 
 	uint16_t next_offset = header.next_offset;
 	ESP_LOGI(TAG_RECORD, "File status for %s", filename);
 	printf("Magic: 0x%08lX %s\n", header.magic,
 				header.magic == HEADER_MAGIC ? "(OK)" : "(CORRUPT!)");
+
+	if (series_is_ring(&header)) {
+		printf("Ring: %d/%d series, cursor %d%s\n", header.last_series_count,
+				header.capacity, header.write_cursor,
+				(header.flags & SERIES_FLAG_WRAPPED) ? " (wrapped)" : "");
+		return;
+	}
+
+	if (series_is_compressed(&header)) {
+		printf("Compressed: %ld series in %d blocks (%d raw bytes)\n", header.total_count,
+				header.block_count, (int)(header.total_count * series_size));
+		return;
+	}
+
+	if (series_is_segmented(&header)) {
+		printf("Segmented: %ld series in %d blocks, max %d\n", header.total_count,
+				header.block_count, SERIES_DIR_COUNT * SERIES_BLOCK_SERIES(series_size));
+		return;
+	}
 	printf("series written: %d, remaining: %d\n",
 				header.last_series_count, (MAX_DATA_SIZE - next_offset) / series_size);
 	printf("Space used: %d/%d bytes\n", HEADER_SIZE + next_offset, RECORD_FILE_BLOCK_SIZE);
@@ -0,0 +1,113 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_heap_caps.h"
+
+// ============================================================================
+// SLAB POOL: fixed size objects backed by lazily allocated slabs
+// ============================================================================
+// the capacity comes from a byte budget at runtime, a slab is allocated when the first
+// slot in it is taken: an empty slot costs a pointer share, not a whole object
+// PSRAM is preferred when heap_caps reports it, internal RAM otherwise
+// slabs are kept once allocated so an object pointer stays valid for other tasks,
+// a released slot is zeroed and handed out again (the caller owns the slot numbers)
+
+#define SLAB_POOL_OBJECTS 4					// objects per slab
+
+typedef struct {
+	uint8_t **slabs;						// NULL until a slot of the slab is taken
+	size_t object_size;
+	uint32_t caps;							// heap_caps of the slabs
+	uint16_t capacity;
+	uint16_t slab_count;
+	uint16_t slabs_allocated;
+	uint16_t live;							// slots taken
+} slab_pool_t;
+
+static uint32_t slab_pool_caps() {
+	if (heap_caps_get_total_size(MALLOC_CAP_SPIRAM) > 0) return MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT;
+	return MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT;
+}
+
+static inline int slab_pool_is_psram(const slab_pool_t *pool) {
+	return (pool->caps & MALLOC_CAP_SPIRAM) != 0;
+}
+
+//* @brief Size the pool from a byte budget (max_count objects at most), returns the capacity
+// only the slab table is allocated here, 0 when the budget doesn't hold one object
+static int slab_pool_init(slab_pool_t *pool, size_t object_size, size_t budget, int max_count) {
+	memset(pool, 0, sizeof(*pool));
+	pool->object_size = object_size;
+	pool->caps = slab_pool_caps();
+
+	size_t capacity = budget / object_size;
+	if (capacity > (size_t)max_count) capacity = max_count;
+	if (capacity == 0) return 0;
+
+	pool->slab_count = (capacity + SLAB_POOL_OBJECTS - 1) / SLAB_POOL_OBJECTS;
+	pool->slabs = calloc(pool->slab_count, sizeof(pool->slabs[0]));
+	if (!pool->slabs) {
+		pool->slab_count = 0;
+		return 0;
+	}
+
+	pool->capacity = capacity;
+	return capacity;
+}
+
+static inline int slab_pool_slab_objects(const slab_pool_t *pool, int slab) {
+	int remaining = pool->capacity - slab * SLAB_POOL_OBJECTS;
+	return remaining < SLAB_POOL_OBJECTS ? remaining : SLAB_POOL_OBJECTS;
+}
+
+//* @brief Returns the object of the slot, NULL when its slab was never allocated
+static inline void* slab_pool_get(const slab_pool_t *pool, int slot) {
+	if (slot < 0 || slot >= pool->capacity) return NULL;
+	uint8_t *slab = pool->slabs[slot / SLAB_POOL_OBJECTS];
+	return slab ? slab + (slot % SLAB_POOL_OBJECTS) * pool->object_size : NULL;
+}
+
+//* @brief Back the slot with memory, returns the zeroed object or NULL when out of memory
+static void* slab_pool_take(slab_pool_t *pool, int slot) {
+	if (slot < 0 || slot >= pool->capacity) return NULL;
+	const int s = slot / SLAB_POOL_OBJECTS;
+
+	if (!pool->slabs[s]) {
+		size_t size = slab_pool_slab_objects(pool, s) * pool->object_size;
+		uint8_t *slab = heap_caps_malloc(size, pool->caps);
+
+		//# PSRAM exhausted - fall back to internal RAM
+		if (!slab && slab_pool_is_psram(pool)) {
+			slab = heap_caps_malloc(size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+		}
+		if (!slab) return NULL;
+
+		pool->slabs[s] = slab;
+		pool->slabs_allocated++;
+	}
+
+	void *object = pool->slabs[s] + (slot % SLAB_POOL_OBJECTS) * pool->object_size;
+	memset(object, 0, pool->object_size);
+	pool->live++;
+	return object;
+}
+
+//* @brief Return the slot - the object is zeroed, its slab stays for the next take
+static void slab_pool_put(slab_pool_t *pool, int slot) {
+	void *object = slab_pool_get(pool, slot);
+	if (!object) return;
+
+	memset(object, 0, pool->object_size);
+	if (pool->live) pool->live--;
+}
+
+static int slab_pool_statsStr(const char *name, const slab_pool_t *pool, char *buffer) {
+	size_t allocated = 0;
+	for (int s = 0; s < pool->slab_count; s++) {
+		if (pool->slabs[s]) allocated += slab_pool_slab_objects(pool, s) * pool->object_size;
+	}
+
+	return sprintf(buffer, "%s pool: %d/%d slots, %d/%d slabs, %d B allocated (%s)\n",
+					name, pool->live, pool->capacity, pool->slabs_allocated, pool->slab_count,
+					allocated, slab_pool_is_psram(pool) ? "PSRAM" : "internal");
+}
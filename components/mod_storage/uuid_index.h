@@ -0,0 +1,144 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+// ============================================================================
+// UUID INDEX: open addressing hash from a device uuid to a storage slot
+// ============================================================================
+// linear probing over a power of 2 table at <= 50% load, removal shifts the probe
+// chain back (no tombstones) so lookups stay O(1) however often devices come and go
+// slots are handed out from a free stack: a deleted device's slot is reused first
+// uuid 0 is the empty key - it is never a device
+// pure C, no ESP dependencies: the caller owns the arrays and the locking
+
+// table size for n slots: power of 2 >= 2n
+#define UUID_INDEX_MAX_SLOTS 1024
+#define UUID_INDEX_SIZE(n) ( \
+	(n) <= 8 ? 16 : (n) <= 16 ? 32 : (n) <= 32 ? 64 : (n) <= 64 ? 128 : \
+	(n) <= 128 ? 256 : (n) <= 256 ? 512 : (n) <= 512 ? 1024 : 2048)
+
+typedef struct {
+	uint32_t *keys;				// UUID_INDEX_SIZE entries, 0 = empty
+	uint16_t *slots;			// slot of each key
+	uint16_t *free_slots;		// stack of the released slots (slot_count entries)
+	uint16_t mask;				// table size - 1
+	uint16_t slot_count;
+	uint16_t count;				// uuids in the index
+	uint16_t free_top;
+	uint16_t next_slot;			// slots never handed out start here
+} uuid_index_t;
+
+// static initializer - keys / slots are the table arrays, free_slots holds slot_count entries
+#define UUID_INDEX_INIT(keys, slots, free_slots, slot_count) \
+	{ keys, slots, free_slots, sizeof(keys) / sizeof((keys)[0]) - 1, slot_count, 0, 0, 0 }
+
+static inline uint32_t uuid_index_hash(uint32_t uuid) {
+	// murmur3 finalizer: sequential uuids spread over the whole table
+	uuid ^= uuid >> 16;
+	uuid *= 0x85EBCA6B;
+	uuid ^= uuid >> 13;
+	uuid *= 0xC2B2AE35;
+	uuid ^= uuid >> 16;
+	return uuid;
+}
+
+//* @brief Returns the table position of the uuid, or the empty position that ends its chain
+static inline uint32_t uuid_index_probe(const uuid_index_t *index, uint32_t uuid) {
+	uint32_t pos = uuid_index_hash(uuid) & index->mask;
+	while (index->keys[pos] && index->keys[pos] != uuid) {
+		pos = (pos + 1) & index->mask;
+	}
+	return pos;
+}
+
+//* @brief Returns the slot of the uuid, -1 when it isn't indexed
+static inline int uuid_index_find(const uuid_index_t *index, uint32_t uuid) {
+	if (uuid == 0 || !index->keys) return -1;
+	uint32_t pos = uuid_index_probe(index, uuid);
+	return index->keys[pos] ? index->slots[pos] : -1;
+}
+
+//* @brief Returns the slot of the uuid - a new uuid takes a free slot, -1 when all slots are taken
+// created (optional) = 1 when the slot was just handed out
+static int uuid_index_acquire(uuid_index_t *index, uint32_t uuid, int *created) {
+	if (created) *created = 0;
+	if (uuid == 0 || !index->keys) return -1;
+
+	uint32_t pos = uuid_index_probe(index, uuid);
+	if (index->keys[pos]) return index->slots[pos];
+
+	uint16_t slot;
+	if (index->free_top > 0) {
+		slot = index->free_slots[--index->free_top];
+	} else if (index->next_slot < index->slot_count) {
+		slot = index->next_slot++;
+	} else {
+		return -1;
+	}
+
+	index->keys[pos] = uuid;
+	index->slots[pos] = slot;
+	index->count++;
+	if (created) *created = 1;
+	return slot;
+}
+
+//* @brief Remove the uuid and return its slot to the free stack, returns the slot or -1
+// backward shift: entries after the hole move up when the hole is on their probe path
+static int uuid_index_release(uuid_index_t *index, uint32_t uuid) {
+	if (uuid == 0 || !index->keys) return -1;
+
+	uint32_t hole = uuid_index_probe(index, uuid);
+	if (!index->keys[hole]) return -1;
+
+	int slot = index->slots[hole];
+	index->free_slots[index->free_top++] = slot;
+	index->count--;
+
+	uint32_t pos = hole;
+	for (;;) {
+		pos = (pos + 1) & index->mask;
+		if (!index->keys[pos]) break;
+
+		// the entry may fill the hole if its home isn't cyclically in (hole, pos]
+		uint32_t home = uuid_index_hash(index->keys[pos]) & index->mask;
+		if (((pos - home) & index->mask) >= ((pos - hole) & index->mask)) {
+			index->keys[hole] = index->keys[pos];
+			index->slots[hole] = index->slots[pos];
+			hole = pos;
+		}
+	}
+
+	index->keys[hole] = 0;
+	return slot;
+}
+
+//* @brief Allocate the arrays of an index for slot_count slots (UUID_INDEX_MAX_SLOTS at most)
+// returns 0 when out of memory
+static int uuid_index_create(uuid_index_t *index, int slot_count) {
+	const size_t size = UUID_INDEX_SIZE(slot_count);
+	memset(index, 0, sizeof(*index));
+
+	index->keys = calloc(size, sizeof(index->keys[0]));
+	index->slots = calloc(size, sizeof(index->slots[0]));
+	index->free_slots = calloc(slot_count ? slot_count : 1, sizeof(index->free_slots[0]));
+	if (!index->keys || !index->slots || !index->free_slots) {
+		free(index->keys);
+		free(index->slots);
+		free(index->free_slots);
+		memset(index, 0, sizeof(*index));
+		return 0;
+	}
+
+	index->mask = size - 1;
+	index->slot_count = slot_count;
+	return 1;
+}
+
+static inline void uuid_index_clear(uuid_index_t *index) {
+	memset(index->keys, 0, (index->mask + 1) * sizeof(index->keys[0]));
+	index->count = 0;
+	index->free_top = 0;
+	index->next_slot = 0;
+}
@@ -17,16 +17,16 @@ void elapse_print(const char *prefix, uint64_t *timestamp) {
 #include "mod_nvs.h"
 #include "mod_spi.h"
 #include "mod_sd.h"
+#include "lttb.h"
+#include "http_stream.h"
 
 #include "../components/analytics.h"
 
 #define RECORD_SIZE sizeof(record_t)				// 10 bytes
-#define HTTP_CHUNK_SIZE 4096
-static char HTTP_FILE_BUFFER[HTTP_CHUNK_SIZE];
+#define ENVELOPE_SIZE sizeof(envelope_t)			// 30 bytes: /g_rec?fmt=env
+#define HTTP_CHUNK_SIZE HTTP_STREAM_CHUNK
+static char HTTP_FILE_BUFFER[HTTP_CHUNK_SIZE];		// /g_rec ranges and caches, inline streams
 
-// why: use mutex to prevent simultaneous access to sd card from logging and http requests
-// design: mutex on read and queue on write to SD card
-SemaphoreHandle_t FS_MUTEX = NULL;
 atomic_stats_t http_stats = {0};
 
 void SERV_RELOAD_LOGS();
@@ -252,26 +252,40 @@ esp_err_t HTTP_UPDATE_NVS_HANDLER(httpd_req_t *req) {
 }
 
 
-int FS_ACCESS_START(httpd_req_t *req) {
+// lock the FS stripe key (fs_lock_key_path / fs_lock_key_uuid) for the request - given back by FS_ACCESS_RELEASE
+// readers of a device run together, a writer (storage task, /u_file) only blocks its own stripe
+int FS_ACCESS_START(httpd_req_t *req, fs_lock_t *lock, int key, fs_lock_mode_t mode) {
 	atomic_tracker_start(&http_stats);
 
-	// #Take Mutex - if FS is locked (wait max 50 seconds)
-	// also prevent changes on params when multiple clients request simultaneously
-	if (xSemaphoreTake(FS_MUTEX, pdMS_TO_TICKS(50)) != pdTRUE) {
-		// FS is busy - tell client to wait
+	// #Take the stripe - wait up to FS_LOCK_WAIT_MS for a writer of the same device
+	if (!fs_lock_take(lock, key, mode, CONFIG_FS_LOCK_WAIT_MS)) {
+		// FS is busy - tell client when to retry
+		char retry_after[8];
+		snprintf(retry_after, sizeof(retry_after), "%d", CONFIG_FS_BUSY_RETRY_AFTER_S);
 		atomic_tracker_end(&http_stats);
-		httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "FS busy");
+		httpd_resp_set_status(req, "503 Service Unavailable");
+		httpd_resp_set_hdr(req, "Retry-After", retry_after);
+		httpd_resp_send(req, "FS busy", HTTPD_RESP_USE_STRLEN);
 		return 0;
 	}
 
 	return 1;
 }
 
-void FS_ACCESS_RELEASE() {
-	xSemaphoreGive(FS_MUTEX);
+void FS_ACCESS_RELEASE(fs_lock_t *lock) {
+	fs_lock_give(lock);
 	atomic_tracker_end(&http_stats);
 }
 
+// stripe of a create / delete / rename: one device stays on its stripe, anything wider takes every stripe
+static int http_fs_key_change(const char *old_path, const char *new_path) {
+	if (!old_path[0]) return fs_lock_key_path(new_path);
+	if (!new_path[0]) return fs_lock_key_path(old_path);
+
+	int key = fs_lock_key_path(old_path);
+	return key == fs_lock_key_path(new_path) ? key : FS_LOCK_ALL;
+}
+
 // fs_access
 // /s_config
 esp_err_t HTTP_SAVE_CONFIG_HANDLER(httpd_req_t *req) {
@@ -304,102 +318,427 @@ esp_err_t HTTP_SAVE_CONFIG_HANDLER(httpd_req_t *req) {
 
 	//# FS_ACCESS: start here to allow other tasks to work while this handler get to this point
 	// concurrent requests will be waiting here, they all have their own stack so their variables are safe
-	if (!FS_ACCESS_START(req)) return ESP_OK;
+	// the device registry and config.txt: every stripe
+	fs_lock_t lock;
+	if (!FS_ACCESS_START(req, &lock, FS_LOCK_ALL, FS_LOCK_WRITE)) return ESP_OK;
 
 	if (sd_save_config(uuid, config) != ESP_OK) {
-		FS_ACCESS_RELEASE();	//# FS RELEASE
+		FS_ACCESS_RELEASE(&lock);	//# FS RELEASE
 		return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to save config");
 	}
 
-	FS_ACCESS_RELEASE();	//# FS RELEASE
+	FS_ACCESS_RELEASE(&lock);	//# FS RELEASE
 	return httpd_resp_send(req, "OK", HTTPD_RESP_USE_STRLEN);
 }
 
+//# ETag (conditional GET): a hash of what the response is built from - 304 when the client has it
+// series files: their header (last_timestamp, next_offset, sequence move on every insert)
+// other files: size + mtime, hourly caches: the generation bumped by cache_inject_records
+#define HTTP_ETAG_SEED 2166136261u				// FNV-1a
+#define HTTP_ETAG_LEN 12						// "xxxxxxxx" quoted
+
+typedef struct {
+	uint32_t checked;					// responses with an ETag
+	uint32_t not_modified;				// 304 sent
+} http_etag_stats_t;
+
+static http_etag_stats_t http_etag_stats = {0};
+
+static uint32_t http_etag_mix(uint32_t hash, const void *data, size_t len) {
+	const uint8_t *ptr = (const uint8_t*)data;
+	for (size_t i = 0; i < len; i++) {
+		hash = (hash ^ ptr[i]) * 16777619u;		// FNV prime
+	}
+	return hash;
+}
+
+// mix the header of a series file - peeked: the live handles stay cached, a lazy header is the current one
+// no header (missing file, no free FATFS file): a tag that never matches
+static uint32_t http_etag_series(uint32_t hash, const char *path) {
+	file_header_t header = {0};
+	hash = http_etag_mix(hash, path, strlen(path));
+
+	if (!series_header_peek(path, &header)) {
+		const int64_t now = esp_timer_get_time();
+		return http_etag_mix(hash, &now, sizeof(now));
+	}
+	return http_etag_mix(hash, &header, HEADER_SIZE);
+}
+
+// mix the size + mtime of a file, its header too when it is a series file (same size rewrites)
+static uint32_t http_etag_file(uint32_t hash, FILE *file, const char *path) {
+	struct stat st;
+	file_header_t header;
+	hash = http_etag_mix(hash, path, strlen(path));
+
+	if (stat(path, &st) == 0) {
+		hash = http_etag_mix(hash, &st.st_size, sizeof(st.st_size));
+		hash = http_etag_mix(hash, &st.st_mtime, sizeof(st.st_mtime));
+	}
+
+	fseek(file, 0, SEEK_SET);
+	if (fread(&header, 1, HEADER_SIZE, file) == HEADER_SIZE &&
+		(header.magic == HEADER_MAGIC || header.magic == HEADER_MAGIC_LEGACY)
+	) {
+		hash = http_etag_mix(hash, &header, HEADER_SIZE);
+	}
+	fseek(file, 0, SEEK_SET);
+	return hash;
+}
+
+//* @brief Set the ETag of hash (etag: HTTP_ETAG_LEN, alive until the response is sent)
+// returns 1 when If-None-Match already has it: the 304 is sent, the handler sends nothing else
+static int http_etag_match(httpd_req_t *req, char *etag, uint32_t hash) {
+	snprintf(etag, HTTP_ETAG_LEN, "\"%08lX\"", hash);
+	httpd_resp_set_hdr(req, "ETag", etag);
+	httpd_resp_set_hdr(req, "Cache-Control", "no-cache");		// the browser revalidates every poll
+	http_etag_stats.checked++;
+
+	char if_none_match[64] = {0};
+	size_t len = httpd_req_get_hdr_value_len(req, "If-None-Match");
+	if (!len || len >= sizeof(if_none_match)) return 0;
+	httpd_req_get_hdr_value_str(req, "If-None-Match", if_none_match, sizeof(if_none_match));
+	if (!strstr(if_none_match, etag) && strcmp(if_none_match, "*") != 0) return 0;
+
+	http_etag_stats.not_modified++;
+	httpd_resp_set_status(req, "304 Not Modified");
+	httpd_resp_send(req, NULL, 0);
+	return 1;
+}
+
+int http_etag_statsStr(char *buffer) {
+	http_etag_stats_t *stats = &http_etag_stats;
+	return sprintf(buffer, "ETag: %ld tagged responses, %ld not modified (304)\n",
+			stats->checked, stats->not_modified);
+}
+
+static int http_fill_file(void *ctx, char *buffer, size_t size) {
+	FILE *file = (FILE*)ctx;
+	size_t bytes_read = fread(buffer, 1, size, file);
+	return bytes_read ? (int)bytes_read : (ferror(file) ? -1 : 0);
+}
+
 // fs_access
+// buffer (HTTP_CHUNK_SIZE): only when no stream is free, the reader task fills its own otherwise
+// sends the whole response: 404, 503, 304 or the chunks and their end
 esp_err_t http_send_file_chunks(httpd_req_t *req, void *buffer, const char *path) {
-	if (!FS_ACCESS_START(req)) return ESP_OK;
+	fs_lock_t lock;
+	if (!FS_ACCESS_START(req, &lock, fs_lock_key_path(path), FS_LOCK_READ)) return ESP_OK;
 	const char method_name[] = "http_send_file_chunks";
+	series_handle_evict(path);				// flush a cached series handle first
 	FILE* file = fopen(path, "rb");			// ~7.0ms
 
 	if (file == NULL) {
 		ESP_LOGE(TAG_HTTP, "Err %s Not Found %s", method_name, path);
-		FS_ACCESS_RELEASE();	//# FS RELEASE
+		FS_ACCESS_RELEASE(&lock);	//# FS RELEASE
 		return httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "File not found");
 	}
 
-	// Stream file content in chunks
-	size_t bytes_read;
-	size_t total_bytes = 0;
-	uint64_t start_time;
+	// unchanged since the client got it: the header / stat only
+	char etag[HTTP_ETAG_LEN];
+	if (http_etag_match(req, etag, http_etag_file(HTTP_ETAG_SEED, file, path))) {
+		fclose(file);
+		FS_ACCESS_RELEASE(&lock);	//# FS RELEASE
+		return ESP_OK;
+	}
 
+	// Stream file content: read ahead while the previous chunk is sent
+	uint64_t start_time;
 	elapse_start(&start_time);
+	int total_bytes = http_stream_send(req, http_fill_file, file, buffer);
 
-	while ((bytes_read = fread(buffer, 1, HTTP_CHUNK_SIZE, file)) > 0) {
-		esp_err_t ret = httpd_resp_send_chunk(req, buffer, bytes_read);
-		if (ret != ESP_OK) {
-			ESP_LOGE(TAG_HTTP, "Err %s httpd_resp_send_chunk", method_name);
-			fclose(file);
-			FS_ACCESS_RELEASE();	//# FS RELEASE
-			return ret;
-		}
-		total_bytes += bytes_read;
+	if (total_bytes < 0) {
+		ESP_LOGE(TAG_HTTP, "Err %s streaming %s", method_name, path);
+	} else {
+		ESP_LOGW(TAG_HTTP, "%s sent: %s %dB in %lldus",
+			method_name, path, total_bytes, elapse_stop(&start_time));
 	}
-
-	ESP_LOGW(TAG_HTTP, "%s sent: %s %dB in %lldus",
-		method_name, path, total_bytes, elapse_stop(&start_time));
 	fclose(file);
-	FS_ACCESS_RELEASE();	//# FS RELEASE
+	FS_ACCESS_RELEASE(&lock);	//# FS RELEASE
 
-	return ESP_OK;
+	if (total_bytes < 0) return ESP_FAIL;
+	return httpd_resp_send_chunk(req, NULL, 0);
 }
 
-int http_send_record_chunks(httpd_req_t *req, char *path, char *chunk_buffer) {
-	if (!FS_ACCESS_START(req)) return 0;
+// convert count series read at file_size to out_size in place: envelope means or widened records
+static void http_fit_series(char *buffer, int count, size_t file_size, size_t out_size) {
+	if (file_size == out_size) return;
+	if (out_size == RECORD_SIZE) envelope_to_records(buffer, count);
+	else records_to_envelopes(buffer, count);
+}
+
+// series of a record file read chunk by chunk (reader task)
+// the handle cache is locked per chunk: the writer and the other devices' reads go between chunks
+typedef struct {
+	const char *path;
+	file_header_t header;
+	size_t file_size;
+	size_t out_size;
+	int chunk_series;
+	int index;
+	int total;
+} http_series_reader_t;
+
+static int http_fill_series(void *ctx, char *buffer, size_t size) {
+	http_series_reader_t *reader = (http_series_reader_t*)ctx;
+	if (reader->index >= reader->total) return 0;
+
+	int count = reader->total - reader->index;
+	if (count > reader->chunk_series) count = reader->chunk_series;
+
+	FILE *file = series_handle_acquire(reader->path);		// a hit: the handle stays cached between chunks
+	if (!file) return -1;
+	count = series_read_slots(file, &reader->header, reader->file_size, reader->index, count, buffer);
+	series_handle_release();
+	if (!count) return 0;
+
+	http_fit_series(buffer, count, reader->file_size, reader->out_size);
+	reader->index += count;
+	return count * reader->out_size;
+}
+
+// stream the series of a record file (flat, segmented or compressed) - returns -1 when the response failed
+// out_size: RECORD_SIZE or ENVELOPE_SIZE, whatever the file holds
+int http_send_record_chunks(httpd_req_t *req, char *path, char *chunk_buffer, size_t out_size) {
+	fs_lock_t lock;
+	if (!FS_ACCESS_START(req, &lock, fs_lock_key_path(path), FS_LOCK_READ)) return -1;
 	const char method_name[] = "http_send_record_chunks";
-	FILE* file = fopen(path, "rb");		// ~7.0ms
+	FILE* file = series_handle_acquire(path);		// cached handle shared with the writer
 
 	if (!file) {
 		ESP_LOGE(TAG_HTTP, "Err %s Not Found %s", method_name, path);
-		FS_ACCESS_RELEASE();
+		FS_ACCESS_RELEASE(&lock);
 		httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, NULL);
-		return 0;
+		return -1;
 	}
 
-	size_t bytes_read;
+	// the header as of now (a lazy one included): the series appended during the send are left out
+	http_series_reader_t reader = { .path = path, .out_size = out_size };
+	series_header_read(file, &reader.header);
+	series_handle_release();
+
+	// the written series only, decoded when compressed: ~3ms a chunk, read ahead while the previous is sent
+	reader.file_size = reader.header.series_size ? reader.header.series_size : RECORD_SIZE;
+	reader.chunk_series = HTTP_CHUNK_SIZE / (reader.file_size > out_size ? reader.file_size : out_size);
+	reader.total = (reader.header.magic == HEADER_MAGIC) ? series_count_of(&reader.header) : 0;
+
+	int total_bytes = http_stream_send(req, http_fill_series, &reader, chunk_buffer);
+	if (total_bytes < 0) ESP_LOGE(TAG_HTTP, "Err %s sending_chunk", method_name);
+
+	FS_ACCESS_RELEASE(&lock);
+
+	return total_bytes;
+}
+
+// stream the records of path with t_start <= timestamp <= t_end - returns -1 when the response failed
+// lttb (optional): the records go to the downsample instead, out_size must be RECORD_SIZE
+int http_send_record_range(
+	httpd_req_t *req, const char *path, uint32_t t_start, uint32_t t_end,
+	char *chunk_buffer, size_t out_size, lttb_t *lttb
+) {
+	fs_lock_t lock;
+	if (!FS_ACCESS_START(req, &lock, fs_lock_key_path(path), FS_LOCK_READ)) return -1;
+	const char method_name[] = "http_send_record_range";
+	const size_t file_size = record_file_series_size(path);
+	const int chunk_series = HTTP_CHUNK_SIZE / (file_size > out_size ? file_size : out_size);
 	size_t total_bytes = 0;
-	file_header_t header;
-	// Skip header ~ 1.8ms fseek and fread takes about the same time
-	fread(&header, 1, HEADER_SIZE, file);
 
-	// ~3ms to read a chunk
-	while ((bytes_read = fread(chunk_buffer, 1, HTTP_CHUNK_SIZE, file)) > 0) {
-		// uint32_t f_timestamp = *(uint32_t*)buffer;
-        // printf("*** f_timestamp: %ld\n", f_timestamp);
+	while (t_start <= t_end) {
+		int count = series_file_query(path, t_start, t_end, chunk_buffer, file_size, chunk_series);
+		if (!count) break;
+		http_fit_series(chunk_buffer, count, file_size, out_size);
 
-		// Send entire chunk
-		if (httpd_resp_send_chunk(req, chunk_buffer, bytes_read) != ESP_OK) {
+		int sent = lttb ? lttb_push(lttb, chunk_buffer, count) :
+				httpd_resp_send_chunk(req, chunk_buffer, count * out_size) == ESP_OK;
+		if (!sent) {
 			ESP_LOGE(TAG_HTTP, "Err %s sending_chunk", method_name);
-			fclose(file);
-			FS_ACCESS_RELEASE();
-			return 0;
+			FS_ACCESS_RELEASE(&lock);
+			return -1;
 		}
-		total_bytes += bytes_read;
+		total_bytes += count * out_size;
+
+		// continue after the last record of the chunk (timestamp first in both formats)
+		uint32_t last_timestamp;
+		memcpy(&last_timestamp, chunk_buffer + (count - 1) * out_size, sizeof(last_timestamp));
+		if (count < chunk_series || last_timestamp >= t_end) break;
+		t_start = last_timestamp + 1;
 	}
-	fclose(file);
-	FS_ACCESS_RELEASE();
+	FS_ACCESS_RELEASE(&lock);
 
 	return total_bytes;
 }
 
+#define DAY_FILE_NONE 0
+#define DAY_FILE_SEGMENTED 1					// MMDD.bin
+#define DAY_FILE_LEGACY 2						// MMDD-0.bin, MMDD-1.bin ...
+
+// first file of a day in file_path, returns its DAY_FILE_ kind
+// the day manifest of the writer answers for the current year, stat otherwise
+static int http_day_filePath(
+	char *file_path, const day_manifest_t *manifest, uint32_t uuid, int year, int month, int day
+) {
+	const int listed = day_manifest_loaded(manifest, year%100);
+	struct stat st;
+
+	touch_day_filePath(file_path, uuid, year%100, month, day);
+	if (listed ? day_manifest_has(manifest, month, day) : stat(file_path, &st) == 0) {
+		return DAY_FILE_SEGMENTED;
+	}
+
+	touch_series_filePath(file_path, uuid, year%100, month, day, 0);
+	if (listed ? day_manifest_has_legacy(manifest, month, day) : stat(file_path, &st) == 0) {
+		return DAY_FILE_LEGACY;
+	}
+	return DAY_FILE_NONE;
+}
+
+#define HTTP_RANGE_MAX_DAYS 31					// longer ranges: win= and the rollup files
+
+// one day file of a range with its part of [t_start, t_end] - < 0 stops the walk
+typedef int (*http_day_file_fn)(void *ctx, const char *path, uint32_t from, uint32_t to);
+
+// walk the day files of [t_start, t_end] in time order - returns the files, -1 when file_fn stopped
+static int http_day_range_files(
+	const day_manifest_t *manifest, uint32_t uuid, uint32_t t_start, uint32_t t_end,
+	http_day_file_fn file_fn, void *ctx
+) {
+	char file_path[64];
+	int files = 0;
+
+	// local days, as the writer picks the day file of a record
+	uint32_t day_start = t_start - (t_start - TIME_OFFSET) % 86400;
+
+	for (; day_start <= t_end; day_start += 86400) {
+		const uint32_t day_end = day_start + 86399;
+		const uint32_t from = t_start > day_start ? t_start : day_start;
+		const uint32_t to = t_end < day_end ? t_end : day_end;
+		rtc_date_t date = RTC_get_date(day_start, 1970, TIME_OFFSET);
+
+		int kind = http_day_filePath(file_path, manifest, uuid, date.year, date.month, date.day);
+		if (kind == DAY_FILE_NONE) continue;
+
+		// legacy days: MMDD-0.bin, MMDD-1.bin ... until a missing one
+		for (int file_idx = 1; ; file_idx++) {
+			if (file_fn(ctx, file_path, from, to) < 0) return -1;
+			files++;
+
+			struct stat st;
+			if (kind == DAY_FILE_SEGMENTED) break;
+			touch_series_filePath(file_path, uuid, date.year%100, date.month, date.day, file_idx);
+			if (stat(file_path, &st) != 0) break;
+		}
+		if (day_end >= t_end) break;		// no wrap past UINT32_MAX
+	}
+	return files;
+}
+
+typedef struct {
+	httpd_req_t *req;
+	size_t out_size;
+	lttb_t *lttb;
+	int total_bytes;
+} http_range_send_t;
+
+static int http_range_send_file(void *ctx, const char *path, uint32_t from, uint32_t to) {
+	http_range_send_t *range = (http_range_send_t*)ctx;
+	int sent = http_send_record_range(range->req, path, from, to, HTTP_FILE_BUFFER, range->out_size, range->lttb);
+	if (sent > 0) range->total_bytes += sent;
+	return sent;
+}
+
+// stream the 1 minute records of [t_start, t_end] day after day - returns -1 when the response failed
+// only the day files of the range are opened, series_file_query skips a file outside of it on its header
+int http_send_day_range(
+	httpd_req_t *req, const day_manifest_t *manifest, uint32_t uuid,
+	uint32_t t_start, uint32_t t_end, size_t out_size, lttb_t *lttb
+) {
+	const char method_name[] = "http_send_day_range";
+	http_range_send_t range = { .req = req, .out_size = out_size, .lttb = lttb };
+
+	int files = http_day_range_files(manifest, uuid, t_start, t_end, http_range_send_file, &range);
+	if (files < 0) return -1;
+
+	ESP_LOGI(TAG_HTTP, "%s RANGE-SENT", method_name);
+	printf("- Range: %ld -> %ld, %d files, %d B\n", t_start, t_end, files, range.total_bytes);
+	return range.total_bytes;
+}
+
+// mix the headers of the day files of a range (http_day_range_files)
+static int http_etag_range_file(void *ctx, const char *path, uint32_t from, uint32_t to) {
+	uint32_t *hash = (uint32_t*)ctx;
+	*hash = http_etag_series(*hash, path);
+	return 0;
+}
+
+//# LTTB downsample (/g_rec pts=): the kept records are gathered in chunks of HTTP_LTTB_CHUNK
+// the server runs one handler at a time: one downsample state for every request (~6KB)
+#define HTTP_LTTB_CHUNK (85 * RECORD_SIZE)
+
+typedef struct {
+	httpd_req_t *req;
+	int len;
+	int sent;
+	char buffer[HTTP_LTTB_CHUNK];
+} http_lttb_out_t;
+
+static lttb_t HTTP_LTTB;
+static http_lttb_out_t HTTP_LTTB_OUT;
+
+static int http_lttb_flush(http_lttb_out_t *out) {
+	if (!out->len) return 1;
+	int ok = httpd_resp_send_chunk(out->req, out->buffer, out->len) == ESP_OK;
+	out->sent += out->len;
+	out->len = 0;
+	return ok;
+}
+
+static int http_lttb_emit(void *ctx, const uint8_t *series) {
+	http_lttb_out_t *out = (http_lttb_out_t*)ctx;
+	memcpy(out->buffer + out->len, series, RECORD_SIZE);
+	out->len += RECORD_SIZE;
+	return out->len + RECORD_SIZE > HTTP_LTTB_CHUNK ? http_lttb_flush(out) : 1;
+}
+
+// downsample of [t_start, t_end] to points records (value_index drives the pick) for records
+// resolution seconds apart - NULL when the range has no more records than points (sent raw)
+static lttb_t* http_lttb_begin(
+	httpd_req_t *req, uint32_t t_start, uint32_t t_end, uint32_t resolution, int points, int value_index
+) {
+	if (points <= 0 || t_end < t_start) return NULL;
+	if ((t_end - t_start) / resolution + 1 <= (uint32_t)points) return NULL;
+
+	// buckets of LTTB_BUCKET_MAX records at most
+	int min_points = lttb_min_points(t_start, t_end, resolution);
+	if (points < min_points) points = min_points;
+
+	memset(&HTTP_LTTB_OUT, 0, offsetof(http_lttb_out_t, buffer));
+	HTTP_LTTB_OUT.req = req;
+	lttb_init(&HTTP_LTTB, t_start, t_end, points, RECORD_SIZE, value_index, http_lttb_emit, &HTTP_LTTB_OUT);
+	return &HTTP_LTTB;
+}
+
+// emit the last points, returns the bytes sent or -1 when the response failed
+static int http_lttb_end(lttb_t *lttb) {
+	const char method_name[] = "http_lttb_end";
+	lttb_finish(lttb);
+	if (lttb->aborted || !http_lttb_flush(&HTTP_LTTB_OUT)) return -1;
+
+	ESP_LOGI(TAG_HTTP, "%s LTTB-SENT", method_name);
+	printf("- Downsampled: %ld -> %ld records (%ld over a bucket)\n", lttb->pushed, lttb->emitted, lttb->overflow);
+	return HTTP_LTTB_OUT.sent;
+}
+
 int get_n_records(
 	httpd_req_t *req, char *path, char *read_buffer, char *OUTPUT_BUFFER, size_t n_records
 ) {
-	if (!FS_ACCESS_START(req)) return 0;
+	fs_lock_t lock;
+	if (!FS_ACCESS_START(req, &lock, fs_lock_key_path(path), FS_LOCK_READ)) return 0;
 
+	series_handle_evict(path);
 	FILE* file = fopen(path, "rb");
 	if (!file) {
 		ESP_LOGE(TAG_HTTP, "Err open %s", path);
-		FS_ACCESS_RELEASE();
+		FS_ACCESS_RELEASE(&lock);
 		httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, NULL);
 		return 0;
 	}
@@ -447,7 +786,7 @@ int get_n_records(
 	}
 
 	fclose(file);
-	FS_ACCESS_RELEASE();
+	FS_ACCESS_RELEASE(&lock);
 	printf("**** records_collected %d\n", records_collected);
 
 	elapse_print("*** sd readtime", &start_time);
@@ -468,12 +807,17 @@ esp_err_t HTTP_GET_RECORDS_HANDLER(httpd_req_t *req) {
 	char month_str[3] = {0};
 	char day_str[3] = {0};
 	char window_str[8] = {0};
+	char format_str[8] = {0};
 	int window = 0, year = 0, month = 0, day = 0;
 
 	char minT_str[16] = {0};
 	char maxT_str[16] = {0};
 	uint64_t minT_s = 0, maxT_s = 0;
 
+	char points_str[8] = {0};
+	char value_str[4] = {0};
+	int points = 0, value = 1;
+
 	size_t query_len = httpd_req_get_url_query_len(req) + 1;
 	if (query_len > sizeof(query)) query_len = sizeof(query);
 
@@ -483,6 +827,7 @@ esp_err_t HTTP_GET_RECORDS_HANDLER(httpd_req_t *req) {
 		httpd_query_key_value(query, "mth", month_str, sizeof(month_str));
 		httpd_query_key_value(query, "day", day_str, sizeof(day_str));
 		httpd_query_key_value(query, "win", window_str, sizeof(window_str));
+		httpd_query_key_value(query, "fmt", format_str, sizeof(format_str));
 
 		window = atoi(window_str);
 		year = atoi(year_str);
@@ -493,6 +838,11 @@ esp_err_t HTTP_GET_RECORDS_HANDLER(httpd_req_t *req) {
 		httpd_query_key_value(query, "maxT", maxT_str, sizeof(maxT_str));
 		minT_s = strtoull(minT_str, NULL, 10);
 		maxT_s = strtoull(maxT_str, NULL, 10);
+
+		// pts: target point count (the chart width), val: value driving the downsample (1-4)
+		if (httpd_query_key_value(query, "pts", points_str, sizeof(points_str)) == ESP_OK) points = atoi(points_str);
+		if (httpd_query_key_value(query, "val", value_str, sizeof(value_str)) == ESP_OK) value = atoi(value_str);
+		if (value < 1 || value > 4) value = 1;
 	}
 
 	ESP_LOGI(TAG_HTTP, "%s REQUESTED-DEV", method_name);
@@ -503,53 +853,149 @@ esp_err_t HTTP_GET_RECORDS_HANDLER(httpd_req_t *req) {
 		return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Missing parameters");
 	}
 
+	// fmt=env: envelope_t aggregates (mean, min, max, count), record_t means otherwise
+	// a downsample (pts) keeps whole records: record_t means whatever the format
+	const size_t out_size = strcmp(format_str, "env") == 0 && points <= 0 ? ENVELOPE_SIZE : RECORD_SIZE;
+	lttb_t *lttb = NULL;
+
 	char file_path[64];
-	esp_err_t ret = ESP_OK;
 	uint64_t time_ref;
 	uint32_t uuid = hex_to_uint32_unrolled(device_id);
-	active_records_t *target = find_records_store(uuid);
+	// a copy taken under the device stores lock: the aggregator and the registry change them meanwhile
+	static device_records_view_t target;
+	const int registered = device_records_read(uuid, &target, NULL);
+
+	// ETag: the parameters shaping the body, each branch mixes in the files / cache it is built from
+	// the header reads run under the read lock of the device stripe, released before the body is sent
+	const uint32_t etag_key[] = { uuid, out_size, points, value, window, (uint32_t)minT_s, (uint32_t)maxT_s };
+	uint32_t etag_hash = http_etag_mix(HTTP_ETAG_SEED, etag_key, sizeof(etag_key));
+	char etag[HTTP_ETAG_LEN];
+	fs_lock_t lock;
+
+	if (registered) {
+		if (minT_s && maxT_s) {
+			//# any range: the 1 minute records of the day files it covers, in order
+			if (maxT_s < minT_s || maxT_s > UINT32_MAX || maxT_s - minT_s >= HTTP_RANGE_MAX_DAYS * 86400ULL) {
+				return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Range over 31 days: use win");
+			}
+			ESP_LOGW(TAG_HTTP, "%s RANGE-FILES", method_name);
+
+			if (!FS_ACCESS_START(req, &lock, fs_lock_key_uuid(uuid), FS_LOCK_READ)) return ESP_OK;
+			http_day_range_files(&target.manifest, uuid, minT_s, maxT_s, http_etag_range_file, &etag_hash);
+			FS_ACCESS_RELEASE(&lock);
+			if (http_etag_match(req, etag, etag_hash)) return ESP_OK;
+
+			elapse_start(&time_ref);
+			lttb = http_lttb_begin(req, minT_s, maxT_s, 60, points, value - 1);
+			int sent = http_send_day_range(req, &target.manifest, uuid, minT_s, maxT_s, out_size, lttb);
+			if (sent >= 0 && lttb) sent = http_lttb_end(lttb);
+			elapse_print("- http_send_day_range", &time_ref);
+			if (sent < 0) return ESP_OK;
+		}
+		else if (year > 0 && month > 0 && day > 0) {
+			if (window > 1440 || window == 0) {
+				//# rollup pyramid: 10 minutes up to 7 days, hourly up to 30 days, daily beyond (0 = all)
+				int level = ROLLUP_DAILY;
+				if (window && window <= 10080) level = ROLLUP_10MIN;
+				else if (window && window <= 43200) level = ROLLUP_HOURLY;
+
+				uint32_t t_end = time(NULL);
+				uint32_t t_start = window ? t_end - window * 60 : 0;
+				ESP_LOGW(TAG_HTTP, "%s ROLLUP-FILES level %d", method_name, level);
+
+				// the window slides every second: the body changes when its first rollup period does
+				// not for a downsample, its buckets follow t_start to the second
+				if (!points) {
+					const uint32_t period = ROLLUP_PERIOD_SEC[level];
+					const uint32_t first = window ? (t_start - TIME_OFFSET + period - 1) / period : 0;
+					etag_hash = http_etag_mix(etag_hash, &first, sizeof(first));
+
+					if (!FS_ACCESS_START(req, &lock, fs_lock_key_uuid(uuid), FS_LOCK_READ)) return ESP_OK;
+					for (uint32_t t = t_start; t <= t_end; t = rollup_file_end(level, t)) {
+						rollup_filePath(file_path, uuid, level, t);
+						etag_hash = http_etag_series(etag_hash, file_path);
+						if (level == ROLLUP_DAILY) break;
+					}
+					FS_ACCESS_RELEASE(&lock);
+					if (http_etag_match(req, etag, etag_hash)) return ESP_OK;
+				}
 
-	if (target) {
-		if (year > 0 && month > 0 && day > 0) {
-			if (window > 299) {
-				touch_series_filePath(file_path, uuid, year%100, month, day, target->file_index);
-				ESP_LOGW(TAG_HTTP, "%s RECORD-FILE", method_name);
-				printf("- Target File: %s\n", file_path);
+				elapse_start(&time_ref);
+				if (window) lttb = http_lttb_begin(req, t_start, t_end, ROLLUP_PERIOD_SEC[level], points, value - 1);
+				for (uint32_t t = t_start; t <= t_end; t = rollup_file_end(level, t)) {
+					rollup_filePath(file_path, uuid, level, t);
+					if (http_send_record_range(req, file_path, t, t_end, HTTP_FILE_BUFFER, out_size, lttb) < 0) return ESP_OK;
+					if (level == ROLLUP_DAILY) break;
+				}
+				if (lttb && http_lttb_end(lttb) < 0) return ESP_OK;
+				elapse_print("- http_send_record_range", &time_ref);
+			}
+			else if (window > 299 && points > 0) {
+				//# whole day downsampled: every file of the day through the range path
+				const uint32_t day_start = RTC_get_seconds(year, month, day, 0, 0, 0) + TIME_OFFSET;
+				ESP_LOGW(TAG_HTTP, "%s RECORD-FILES", method_name);
 
-				file_header_t header;
+				if (!FS_ACCESS_START(req, &lock, fs_lock_key_uuid(uuid), FS_LOCK_READ)) return ESP_OK;
+				http_day_range_files(&target.manifest, uuid, day_start, day_start + 86399, http_etag_range_file, &etag_hash);
+				FS_ACCESS_RELEASE(&lock);
+				if (http_etag_match(req, etag, etag_hash)) return ESP_OK;
 
-				if (!FS_ACCESS_START(req)) return httpd_resp_send_chunk(req, NULL, 0);
 				elapse_start(&time_ref);
-				int len = series_file_read_all(&header, file_path, HTTP_FILE_BUFFER, RECORD_SIZE, 200);	// ~15ms
-				elapse_print("- file read", &time_ref);
-				FS_ACCESS_RELEASE();
+				lttb = http_lttb_begin(req, day_start, day_start + 86399, 60, points, value - 1);
+				int sent = http_send_day_range(req, &target.manifest, uuid, day_start, day_start + 86399, out_size, lttb);
+				if (sent >= 0 && lttb) sent = http_lttb_end(lttb);
+				elapse_print("- http_send_day_range", &time_ref);
+				if (sent < 0) return ESP_OK;
+			}
+			else if (window > 299) {
+				//# whole day: one segmented file, fall back to the first legacy 4KB file
+				if (http_day_filePath(file_path, &target.manifest, uuid, year, month, day) == DAY_FILE_NONE) {
+					touch_day_filePath(file_path, uuid, year%100, month, day);		// answers 404
+				}
+				ESP_LOGW(TAG_HTTP, "%s RECORD-FILE", method_name);
+				printf("- Target File: %s\n", file_path);
+
+				if (!FS_ACCESS_START(req, &lock, fs_lock_key_uuid(uuid), FS_LOCK_READ)) return ESP_OK;
+				etag_hash = http_etag_series(etag_hash, file_path);
+				FS_ACCESS_RELEASE(&lock);
+				if (http_etag_match(req, etag, etag_hash)) return ESP_OK;
 
 				elapse_start(&time_ref);
-				ret = httpd_resp_send(req, HTTP_FILE_BUFFER, len * RECORD_SIZE);					// ~7ms
-				elapse_print("- httpd_resp_send", &time_ref);
-				printf("- startTime: %ld, latestTime: %ld\n", header.start_timestamp, header.last_timestamp);
-				return ret;
-
-				// elapse_start(&time_ref);
-				// http_send_record_chunks(req, file_path, HTTP_FILE_BUFFER);				// ~25ms YUCK
-				// elapse_print("- http_send_record_chunks", &time_ref);
+				int sent = http_send_record_chunks(req, file_path, HTTP_FILE_BUFFER, out_size);
+				elapse_print("- http_send_record_chunks", &time_ref);
+				if (sent < 0) return ESP_OK;
 			}
 			else if (window > 59) {
-				//# load from hourly cache
-				aggregate_cache_t *match = find_aggregate_cache(uuid);
+				//# load from hourly cache - a miss queues the load of the device (evicting a colder one)
+				uint32_t generation[2];
+				int hit = aggregate_cache_read(uuid, (record_t*)HTTP_FILE_BUFFER, generation);
 				ESP_LOGW(TAG_HTTP, "%s HOURLY-CACHE", method_name);
 
-				if (match) {
+				if (hit) {
+					etag_hash = http_etag_mix(etag_hash, generation, sizeof(generation));
+					if (http_etag_match(req, etag, etag_hash)) return ESP_OK;
+
+					// the cache keeps the means: widened for fmt=env (min = max = mean)
+					const int count = AGGREGATE_RECORD_COUNT;
+					http_fit_series(HTTP_FILE_BUFFER, count, RECORD_SIZE, out_size);
+
 					elapse_start(&time_ref);
-					httpd_resp_send(req, (char*)match->min_records, sizeof(match->min_records));	// ~5ms
+					httpd_resp_send(req, HTTP_FILE_BUFFER, count * out_size);	// ~5ms
 					elapse_print("- httpd_resp_send", &time_ref);
 				}
 			}
 			else {
-				//# load from 5 minutes cache
-				// ~5ms for 300 records
+				//# load from 5 minutes cache - raw seconds: record_t whatever the format
+				// ~5ms for 300 records, copied with their ETag fields under the lock
 				ESP_LOGW(TAG_HTTP, "%s 5MINUTES-CACHE", method_name);
-				return httpd_resp_send(req, (const char*)target->sec_records, sizeof(target->sec_records));
+				if (!device_records_read(uuid, &target, (record_t*)HTTP_FILE_BUFFER)) {
+					return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Record not registered");
+				}
+				const uint32_t latest[] = { target.last_timestamp, target.record_idx };
+				etag_hash = http_etag_mix(etag_hash, latest, sizeof(latest));
+				if (http_etag_match(req, etag, etag_hash)) return ESP_OK;
+
+				return httpd_resp_send(req, HTTP_FILE_BUFFER, RECORD_BUFFER_LEN * RECORD_SIZE);
 			}
 		}
 	}
@@ -560,6 +1006,77 @@ esp_err_t HTTP_GET_RECORDS_HANDLER(httpd_req_t *req) {
 	return httpd_resp_send_chunk(req, NULL, 0);
 }
 
+#define INGEST_BUFFER_TUPLES 128			// 2KB: one ingest_records call per 128 records
+#define INGEST_RECV_RETRIES 3
+
+// internal
+// /p_rec - POST body: ingest_tuple_t[] (uuid + record_t, 16 bytes each)
+// accepted = applied, queued = handed to the aggregator: its unknown / out_of_order show in the ingest stats only
+esp_err_t HTTP_POST_RECORDS_HANDLER(httpd_req_t *req) {
+	const char method_name[] = "HTTP_POST_RECORDS_HANDLER";
+	httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+	httpd_resp_set_type(req, "application/json");
+
+	// the server runs one handler at a time: the buffer is reused by every batch
+	static ingest_tuple_t buffer[INGEST_BUFFER_TUPLES];
+
+	if (req->content_len % sizeof(ingest_tuple_t)) {
+		return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Body is not a whole number of records");
+	}
+
+	ingest_result_t total = {0};
+	size_t remaining = req->content_len;
+	uint64_t time_ref;
+	elapse_start(&time_ref);
+
+	while (remaining > 0) {
+		// fill whole tuples: recv may return any part of the body
+		size_t wanted = remaining < sizeof(buffer) ? remaining : sizeof(buffer);
+		size_t filled = 0;
+		int retries = 0;
+
+		while (filled < wanted) {
+			int len = httpd_req_recv(req, (char*)buffer + filled, wanted - filled);
+			if (len == HTTPD_SOCK_ERR_TIMEOUT && ++retries <= INGEST_RECV_RETRIES) continue;
+			if (len <= 0) {
+				ESP_LOGE(TAG_HTTP, "%s RECV-FAILED after %d bytes", method_name, req->content_len - remaining + filled);
+				return ESP_FAIL;
+			}
+			filled += len;
+		}
+		remaining -= filled;
+
+		ingest_result_t result;
+		ingest_records(buffer, filled / sizeof(ingest_tuple_t), &result);
+		total.accepted += result.accepted;
+		total.queued += result.queued;
+		total.unknown += result.unknown;
+		total.out_of_range += result.out_of_range;
+		total.out_of_order += result.out_of_order;
+		total.dropped += result.dropped;
+	}
+
+	uint64_t elapsed = elapse_stop(&time_ref);
+	const uint32_t count = req->content_len / sizeof(ingest_tuple_t);
+	const uint32_t rate = elapsed ? (uint64_t)count * 1000000 / elapsed : 0;
+
+	ESP_LOGI(TAG_HTTP, "%s INGESTED: %ld/%ld records in %lld us", method_name,
+			total.accepted + total.queued, count, elapsed);
+	char json[256];
+	int len = snprintf(json, sizeof(json),
+			"{\"accepted\":%ld,\"queued\":%ld,\"rejected\":%ld,\"unknown\":%ld,\"out_of_range\":%ld,"
+			"\"out_of_order\":%ld,\"dropped\":%ld,\"us\":%lld,\"rate\":%ld}",
+			total.accepted, total.queued, ingest_rejected(&total), total.unknown, total.out_of_range,
+			total.out_of_order, total.dropped, elapsed, rate);
+	return httpd_resp_send(req, json, len);
+}
+
+// udp datagram records (mod_udp.h): same validation and ring as /p_rec
+int UDP_RECORDS_HANDLER(const uint8_t *tuples, int count) {
+	_Static_assert(sizeof(ingest_tuple_t) == UDP_TUPLE_SIZE, "udp tuple is an ingest_tuple_t");
+	return ingest_records((const ingest_tuple_t*)tuples, count, NULL);
+}
+
 // fs_access -internal
 // /g_file
 esp_err_t HTTP_GET_FILE_HANDLER(httpd_req_t *req) {
@@ -580,8 +1097,7 @@ esp_err_t HTTP_GET_FILE_HANDLER(httpd_req_t *req) {
 	for (char *p = path; *p; p++) if (*p == '*') *p = '/';
 	ESP_LOGW(TAG_HTTP, "%s send path %s", method_name, path);
 
-	http_send_file_chunks(req, HTTP_FILE_BUFFER, path);
-	return httpd_resp_send_chunk(req, NULL, 0);
+	return http_send_file_chunks(req, HTTP_FILE_BUFFER, path);
 }
 
 // fs_access
@@ -614,7 +1130,14 @@ esp_err_t HTTP_UPDATE_FILE_HANDLER(httpd_req_t *req) {
 
 	//# FS_ACCESS: start here to allow other tasks to work while this handler get to this point
 	// concurrent requests will be waiting here, they all have their own stack so their variables are safe
-	if (!FS_ACCESS_START(req)) return ESP_OK;
+	fs_lock_t lock;
+	if (!FS_ACCESS_START(req, &lock, http_fs_key_change(old_path, new_path), FS_LOCK_WRITE)) return ESP_OK;
+
+	// release the cached series handles of the touched files, the day manifests relist them
+	if (old_name_len) series_handle_evict(old_path);
+	if (new_name_len) series_handle_evict(new_path);
+	if (old_name_len) device_manifest_forget(old_path);
+	if (new_name_len) device_manifest_forget(new_path);
 
 	// no old_name => Create
 	if (!old_name_len) {
@@ -638,7 +1161,7 @@ esp_err_t HTTP_UPDATE_FILE_HANDLER(httpd_req_t *req) {
 		}
 	}
 
-	FS_ACCESS_RELEASE();		//# FS RELEASE
+	FS_ACCESS_RELEASE(&lock);		//# FS RELEASE
 	return httpd_resp_send(req, "OK", HTTPD_RESP_USE_STRLEN);
 }
 
@@ -680,7 +1203,13 @@ esp_err_t HTTP_UPDATE_ENTRY_HANDLER(httpd_req_t *req) {
 
 	//# FS_ACCESS: start here to allow other tasks to work while this handler get to this point
 	// concurrent requests will be waiting here, they all have their own stack so their variables are safe
-	if (!FS_ACCESS_START(req)) return ESP_OK;
+	fs_lock_t lock;
+	if (!FS_ACCESS_START(req, &lock, http_fs_key_change(old_path, new_path), FS_LOCK_WRITE)) return ESP_OK;
+
+	// release the cached series handles under the touched entries, the day manifests relist them
+	if (old_name_len) series_handle_evict(old_path);
+	if (old_name_len) device_manifest_forget(old_path);
+	if (new_name_len) device_manifest_forget(new_path);
 
 	// no old_name => Create
 	if (!old_name_len) {
@@ -715,12 +1244,11 @@ esp_err_t HTTP_UPDATE_ENTRY_HANDLER(httpd_req_t *req) {
 
 				char file_path[FILE_PATH_LEN];
 				active_records_t *active = find_records_store(target_uuid);
-				active->curr_year = 0;		//! IMPORTANT: force update filepath
 				prepare_aggregate_file(file_path, active, target_uuid, date.year, date.month, date.day);
 
 				uint32_t earliest_tstamp = timestamp - 60 * WRITING_RECORDS_COUNT;
 				uint32_t latest_tstamp = earliest_tstamp;
-				static record_t recs_to_write[WRITING_RECORDS_COUNT] = {0};
+				static envelope_t recs_to_write[WRITING_RECORDS_COUNT] = {0};
 
 				//# generate records for 3 cycles
 				for (int i = 0; i < WRITING_RECORDS_COUNT; i++) {
@@ -728,6 +1256,11 @@ esp_err_t HTTP_UPDATE_ENTRY_HANDLER(httpd_req_t *req) {
 					recs_to_write[i].value1 = random_int(20, 50);
 					recs_to_write[i].value2 = random_int(40, 80);
 					recs_to_write[i].value3 = random_int(0, 100);
+					for (int v = 0; v < 4; v++) {
+						recs_to_write[i].min_values[v] = 0;
+						recs_to_write[i].max_values[v] = random_int(80, 100);
+					}
+					recs_to_write[i].count = 60;
 					latest_tstamp += 60;
 
 					// printf("[%d] timestamp: %ld, value1: %d\n", i,
@@ -737,14 +1270,10 @@ esp_err_t HTTP_UPDATE_ENTRY_HANDLER(httpd_req_t *req) {
 				RTC_printTimeRange("Generated range", earliest_tstamp, latest_tstamp, TIME_OFFSET);
 
 				file_header_t header;
-				int next_offset = series_batch_insert(file_path, &header,
-								recs_to_write, sizeof(record_t), WRITING_RECORDS_COUNT);
-				if (!next_offset) {
+				int data_size = record_file_insert(file_path, &header, recs_to_write, WRITING_RECORDS_COUNT);
+				if (!data_size) {
 					ESP_LOGE(TAG_SF, "%s INVALID-FILE", method_name);
 				}
-				else if (next_offset > RECORD_FILE_BLOCK_SIZE) {
-					ESP_LOGE(TAG_SF, "%s FILE-FULL", method_name);
-				}
 			}
 		}
 	}
@@ -755,7 +1284,7 @@ esp_err_t HTTP_UPDATE_ENTRY_HANDLER(httpd_req_t *req) {
 		ret = sd_rename(old_path, new_path);
 	}
 
-	FS_ACCESS_RELEASE();
+	FS_ACCESS_RELEASE(&lock);
 	return httpd_resp_send(req, "OK", HTTPD_RESP_USE_STRLEN);
 }
 
@@ -812,13 +1341,14 @@ esp_err_t HTTP_GET_ENTRIES_HANDLER(httpd_req_t *req) {
 
 	//# FS_ACCESS: start here to allow other tasks to work while this handler get to this point
 	// concurrent requests will be waiting here, they all have their own stack so their variables are safe
-	if (!FS_ACCESS_START(req)) return ESP_OK;
+	fs_lock_t lock;
+	if (!FS_ACCESS_START(req, &lock, fs_lock_key_path(entry_str), FS_LOCK_READ)) return ESP_OK;
 
 	// text or binary
 	httpd_resp_set_type(req, "text/plain");
 	len = sd_read_tail(entry_str, output, sizeof(output));
 
-	FS_ACCESS_RELEASE();	//# FS RELEASE
+	FS_ACCESS_RELEASE(&lock);	//# FS RELEASE
 	return httpd_resp_send(req, output, len);
 }
 
@@ -850,11 +1380,8 @@ esp_err_t HTTP_GET_LOG_HANDLER(httpd_req_t *req) {
 	int size = atoi(size_str);
 
 	char full_path[64];
-	char buffer[1024];
 	snprintf(full_path, sizeof(full_path), SD_POINT"/log/%s/%s/%s", pa_str, pb_str, pc_str);
-	http_send_file_chunks(req, buffer, full_path);
-
-	return httpd_resp_send_chunk(req, NULL, 0);
+	return http_send_file_chunks(req, HTTP_FILE_BUFFER, full_path);
 }
 
 
@@ -94,6 +94,46 @@ void log_diagnostics_handler() {
 		memset(output, 0, sizeof(output));
 		make_detailed_littlefsStr(output);
 		printf("%s", output);
+
+		memset(output, 0, sizeof(output));
+		series_handle_statsStr(output);
+		printf("%s", output);
+
+		memset(output, 0, sizeof(output));
+		device_pool_statsStr(output);
+		printf("%s", output);
+
+		memset(output, 0, sizeof(output));
+		storage_statsStr(output);
+		printf("%s", output);
+
+		memset(output, 0, sizeof(output));
+		aggregate_cache_statsStr(output, sizeof(output));
+		printf("%s", output);
+
+		memset(output, 0, sizeof(output));
+		ingest_statsStr(output);
+		printf("%s", output);
+
+		memset(output, 0, sizeof(output));
+		udp_statsStr(output);
+		printf("%s", output);
+
+		memset(output, 0, sizeof(output));
+		http_stream_statsStr(output);
+		printf("%s", output);
+
+		memset(output, 0, sizeof(output));
+		http_etag_statsStr(output);
+		printf("%s", output);
+
+		memset(output, 0, sizeof(output));
+		fs_lock_statsStr(output);
+		printf("%s", output);
+
+		memset(output, 0, sizeof(output));
+		storage_warmup_statsStr(output);
+		printf("%s", output);
 	}
 
 	// int pos = make_partition_tableStr(buffer);
@@ -104,7 +144,10 @@ void log_diagnostics_handler() {
 
 void app_main(void) {
 	esp_err_t ret;
-	FS_MUTEX = xSemaphoreCreateMutex();
+	fs_lock_init(CONFIG_FS_LOCK_STRIPES);
+	series_handle_init();
+	device_pool_init(CONFIG_DEVICE_POOL_KB * 1024, CONFIG_AGGREGATE_POOL_KB * 1024,
+						CONFIG_AGGREGATE_HEAP_PERCENT);
 	ESP_LOGI(TAG, "APP START");
 
 	//! nvs_flash required for WiFi, ESP-NOW, and other stuff.
@@ -121,7 +164,8 @@ void app_main(void) {
 	gpio_set_direction(MODE_PIN, GPIO_MODE_INPUT);
 	gpio_set_pull_mode(MODE_PIN, GPIO_PULLUP_ONLY);
 
-	//# Setup Wifi
+	//# Setup Wifi - file downloads read ahead on the stream tasks
+	http_stream_start(CONFIG_HTTP_STREAM_SLOTS);
 	wifi_init_sta();
 
 	//# Init SPI1 peripherals
@@ -153,6 +197,13 @@ void app_main(void) {
 			}
 
 			sd_load_config();
+			storage_writer_start();
+			#ifdef CONFIG_INGEST_DROP_OLDEST
+			ingest_start(CONFIG_INGEST_RING_RECORDS, INGEST_RING_DROP_OLDEST);
+			#else
+			ingest_start(CONFIG_INGEST_RING_RECORDS, INGEST_RING_REJECT);
+			#endif
+			storage_warmup_start();		// low priority: ingest doesn't wait for it
 		}
 	}
 
@@ -175,18 +226,19 @@ void app_main(void) {
 				RTC_datetimeStr(datetime_str, now, TIME_OFFSET);
 				ESP_LOGI(TAG, "DATE-TIME: %s", datetime_str);
 
+				//# simulated sensors: one batch through the same path as /p_rec
+				ingest_tuple_t batch[10];
 				for (int i=0; i<10; i++) {
-					record_t record = {
+					uuid += i;
+					batch[i].uuid = uuid;
+					batch[i].record = (record_t){
 						.timestamp = now,
 						.value1 = random_int(20, 50),
 						.value2 = random_int(40, 80),
 						.value3 = random_int(0, 100),
 					};
-
-					uuid += i;
-					cache_device(uuid, now);
-					cache_n_write_record(uuid, &record, date.year, date.month, date.day);
 				}
+				ingest_records(batch, 10, NULL);
 			}
 
 			wifi_poll();
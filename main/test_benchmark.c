@@ -0,0 +1,444 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "sdkconfig.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+
+int random_int(int min, int max) {
+	return min + rand() % (max - min + 1);
+}
+
+void elapse_start(uint64_t *timestamp) {
+	*timestamp = esp_timer_get_time();
+}
+
+uint64_t elapse_stop(uint64_t *timestamp) {
+	return esp_timer_get_time() - *timestamp;
+}
+
+void elapse_print(const char *prefix, uint64_t *timestamp) {
+	uint64_t elapsed = elapse_stop(timestamp);
+	printf("%s elapsed: %lld us\n", prefix, elapsed);
+}
+
+#include "rtc_helper.h"
+#include "mod_spi.h"
+#include "mod_sd.h"
+
+//! Micro-benchmarks of the storage and aggregation kernels
+// each case runs a kernel N times and prints ns/op and bytes/op (payload moved per op)
+// series files go to a scratch directory on the SD card, removed at the end of every run
+//! WARNING !!!: the insert cases write ~100KB per run to the SD card
+
+#define BENCH_DIR SD_POINT"/bench"
+#define BENCH_CPU_OPS 20000
+#define BENCH_IO_OPS 200
+#define BENCH_DAY_RECORDS 1440						// 1 minute records of one day
+
+static const char *TAG = "#BENCH";
+
+static record_t bench_records[BENCH_DAY_RECORDS];
+static record_t bench_output[BENCH_DAY_RECORDS];
+static char bench_buffer[4096];
+static volatile uint32_t bench_sink;				// keeps the results alive at -O2
+
+static void bench_report(const char *name, uint64_t elapsed, uint32_t ops, uint32_t bytes) {
+	printf("- %-32s %6ld ops %10lld ns/op %8ld B/op\n",
+		name, ops, elapsed * 1000 / ops, bytes / ops);
+}
+
+static void bench_fill_records(uint32_t start, int count) {
+	for (int i = 0; i < count; i++) {
+		record_t *rec = &bench_records[i];
+		rec->timestamp = start + i * 60;
+		rec->value1 = random_int(-500, 500);
+		rec->value2 = random_int(0, 300);
+		rec->value3 = i % 100;
+		rec->value4 = 0;
+	}
+}
+
+//###################################################
+//# CPU KERNELS
+//###################################################
+
+static void bench_hex_to_uint32() {
+	static const char *ids[] = {"AABBCCDD", "0123ABCD", "DEADBEEF", "00000001"};
+	uint32_t acc = 0;
+	uint64_t time_ref;
+
+	elapse_start(&time_ref);
+	for (int i = 0; i < BENCH_CPU_OPS; i++) {
+		acc += hex_to_uint32_unrolled(ids[i & 3]);
+	}
+	bench_report("hex_to_uint32_unrolled", elapse_stop(&time_ref), BENCH_CPU_OPS, BENCH_CPU_OPS * 8);
+	bench_sink = acc;
+}
+
+static void bench_rtc_get_date() {
+	uint32_t timestamp = time(NULL);
+	uint32_t acc = 0;
+	uint64_t time_ref;
+
+	elapse_start(&time_ref);
+	for (int i = 0; i < BENCH_CPU_OPS; i++) {
+		rtc_date_t date = RTC_get_date(timestamp + i * 3600, 1970, TIME_OFFSET);
+		acc += date.day;
+	}
+	bench_report("RTC_get_date", elapse_stop(&time_ref), BENCH_CPU_OPS, BENCH_CPU_OPS * sizeof(rtc_date_t));
+	bench_sink = acc;
+}
+
+static void bench_aggregate_records() {
+	static active_records_t active;
+	envelope_t samples[AGGREGATE_SAMPLE_COUNT];
+	record_t second = {0};
+	uint32_t acc = 0;
+	uint64_t time_ref;
+
+	//# per second: ring write + running bucket sums
+	elapse_start(&time_ref);
+	for (int i = 0; i < BENCH_CPU_OPS; i++) {
+		if (i % RECORD_BUFFER_LEN == 0) {
+			memset(&active, 0, sizeof(active));
+			active.last_aggregate_sec = 1700000000 + i;
+		}
+		second.value1 = i & 0x1FF;
+		second.value2 = i & 0xFF;
+		reload_aggregate_specs(&active, &second, 1700000000 + i);
+	}
+	bench_report("reload_aggregate_specs", elapse_stop(&time_ref), BENCH_CPU_OPS, BENCH_CPU_OPS * sizeof(record_t));
+
+	//# per interval: close the buckets of a full window
+	elapse_start(&time_ref);
+	for (int i = 0; i < BENCH_CPU_OPS; i++) {
+		acc += aggregate_records(&active, samples, AGGREGATE_SAMPLE_COUNT);
+	}
+	bench_report("aggregate_records", elapse_stop(&time_ref), BENCH_CPU_OPS,
+		BENCH_CPU_OPS * sizeof(envelope_t) * AGGREGATE_SAMPLE_COUNT);
+	bench_sink = acc + samples[0].value1;
+}
+
+static void bench_cache_inject_records() {
+	static aggregate_cache_t aggregate;
+	memset(&aggregate, 0, sizeof(aggregate));
+	bench_fill_records(1700000000, AGGREGATE_SAMPLE_COUNT);
+	uint64_t time_ref;
+
+	//# odd start index so a share of the injects wraps around
+	aggregate.circular_index = 3;
+	elapse_start(&time_ref);
+	for (int i = 0; i < BENCH_CPU_OPS; i++) {
+		cache_inject_records(&aggregate, bench_records, AGGREGATE_SAMPLE_COUNT);
+	}
+	bench_report("cache_inject_records", elapse_stop(&time_ref), BENCH_CPU_OPS,
+		BENCH_CPU_OPS * sizeof(record_t) * AGGREGATE_SAMPLE_COUNT);
+	bench_sink = aggregate.circular_index;
+}
+
+//# one 128 records batch per call, 10 devices - windows stay under AGGREGATE_INTERVAL_SEC
+// so the numbers are the ingest path alone (no preload, no insert job)
+// fixed timestamps: the benchmark app never sets the clock (ingest_max_timestamp is then open)
+static void bench_ingest_records() {
+	static ingest_tuple_t batch[128];
+	const int devices = 10;
+	const int window = AGGREGATE_INTERVAL_SEC - 1;
+	const uint32_t start = INGEST_MIN_TIMESTAMP + 86400;
+	int ops = 0, records = 0;
+	uint32_t out_of_range = 0;
+	uint64_t elapsed = 0;
+
+	for (int round = 0; round < BENCH_CPU_OPS / (devices * window); round++) {
+		for (int d = 0; d < devices; d++) {
+			active_records_t *active = register_records_store(0xAABB1000 + d);
+			if (active) active->last_aggregate_sec = start;		// a full pool: counted as unknown
+		}
+
+		for (int second = 1; second <= window; ) {
+			int count = 0;
+			for (; count + devices <= 128 && second <= window; second++) {
+				for (int d = 0; d < devices; d++, count++) {
+					batch[count].uuid = 0xAABB1000 + d;
+					batch[count].record = (record_t){ .timestamp = start + second, .value1 = second };
+				}
+			}
+
+			ingest_result_t result;
+			uint64_t time_ref;
+			elapse_start(&time_ref);
+			records += ingest_records(batch, count, &result);
+			elapsed += elapse_stop(&time_ref);
+			out_of_range += result.out_of_range;
+			ops++;
+		}
+
+		for (int d = 0; d < devices; d++) remove_device(0xAABB1000 + d);
+	}
+	bench_report("ingest_records (batch)", elapsed, ops, records * sizeof(ingest_tuple_t));
+	printf("- ingest: %d records, %lld records/s, %ld out of range (%s)\n", records,
+			elapsed ? records * 1000000LL / elapsed : 0, out_of_range, out_of_range ? "FAIL" : "ok");
+}
+
+//# producer cost of the lock-free ring: one push + one batched pop per record
+static void bench_ingest_ring() {
+	static ingest_tuple_t batch[INGEST_DRAIN_BATCH];
+	ingest_ring_t ring;
+	if (!ingest_ring_create(&ring, 1024, sizeof(ingest_tuple_t), INGEST_RING_REJECT)) return;
+
+	ingest_tuple_t tuple = { .uuid = 0xAABBCCDA };
+	uint64_t time_ref;
+	elapse_start(&time_ref);
+	for (int i = 0; i < BENCH_CPU_OPS; i++) {
+		tuple.record.timestamp = i;
+		ingest_ring_push(&ring, &tuple);
+		if ((i + 1) % INGEST_DRAIN_BATCH == 0) ingest_ring_pop_batch(&ring, batch, INGEST_DRAIN_BATCH);
+	}
+	bench_report("ingest_ring push+pop", elapse_stop(&time_ref), BENCH_CPU_OPS, BENCH_CPU_OPS * sizeof(ingest_tuple_t));
+	ingest_ring_free(&ring);
+}
+
+//# uncontended cost of an http read lock: one device stripe, then every stripe (/s_config)
+static void bench_fs_lock() {
+	fs_lock_t lock;
+	uint64_t time_ref;
+	elapse_start(&time_ref);
+	for (int i = 0; i < BENCH_CPU_OPS; i++) {
+		fs_lock_take(&lock, fs_lock_key_uuid(0xAABBCCDA + i), FS_LOCK_READ, 0);
+		fs_lock_give(&lock);
+	}
+	bench_report("fs_lock read stripe", elapse_stop(&time_ref), BENCH_CPU_OPS, 0);
+
+	const int ops = BENCH_CPU_OPS / 10;
+	elapse_start(&time_ref);
+	for (int i = 0; i < ops; i++) {
+		fs_lock_take(&lock, FS_LOCK_ALL, FS_LOCK_WRITE, 0);
+		fs_lock_give(&lock);
+	}
+	bench_report("fs_lock write all", elapse_stop(&time_ref), ops, 0);
+}
+
+static void bench_device_configs_str() {
+	for (int i = 0; i < ACTIVE_POOL.capacity; i++) {
+		register_records_store(0xAABB0000 + i)->config = i + 1;
+	}
+
+	const int ops = BENCH_CPU_OPS / 10;
+	uint32_t bytes = 0;
+	uint64_t time_ref;
+
+	elapse_start(&time_ref);
+	for (int i = 0; i < ops; i++) {
+		bytes += make_device_configs_str(bench_buffer, sizeof(bench_buffer));
+	}
+	bench_report("make_device_configs_str", elapse_stop(&time_ref), ops, bytes);
+
+	for (int i = 0; i < ACTIVE_POOL.capacity; i++) {
+		remove_device(0xAABB0000 + i);
+	}
+}
+
+//# uuid lookups: hash index vs the linear scan it replaced (hits and misses)
+#define BENCH_INDEX_MAX 1000
+
+static uint32_t bench_uuids[BENCH_INDEX_MAX];
+static uint32_t bench_index_keys[UUID_INDEX_SIZE(BENCH_INDEX_MAX)];
+static uint16_t bench_index_slots[UUID_INDEX_SIZE(BENCH_INDEX_MAX)];
+static uint16_t bench_free_slots[BENCH_INDEX_MAX];
+
+static void bench_uuid_index(int devices) {
+	uuid_index_t index = UUID_INDEX_INIT(bench_index_keys, bench_index_slots, bench_free_slots, devices);
+	uuid_index_clear(&index);
+
+	for (int i = 0; i < devices; i++) {
+		bench_uuids[i] = 0xAABB0000 + i * 7;
+		uuid_index_acquire(&index, bench_uuids[i], NULL);
+	}
+
+	uint32_t acc = 0;
+	uint64_t time_ref;
+	char label[40];
+
+	//# every other lookup misses (uuid not registered)
+	elapse_start(&time_ref);
+	for (int i = 0; i < BENCH_CPU_OPS; i++) {
+		uint32_t uuid = bench_uuids[i % devices] + (i & 1);
+		acc += uuid_index_find(&index, uuid);
+	}
+	snprintf(label, sizeof(label), "uuid_index_find %d", devices);
+	bench_report(label, elapse_stop(&time_ref), BENCH_CPU_OPS, BENCH_CPU_OPS * sizeof(uint32_t));
+
+	elapse_start(&time_ref);
+	for (int i = 0; i < BENCH_CPU_OPS; i++) {
+		uint32_t uuid = bench_uuids[i % devices] + (i & 1);
+		for (int j = 0; j < devices; j++) {
+			if (bench_uuids[j] == uuid) {
+				acc += j;
+				break;
+			}
+		}
+	}
+	snprintf(label, sizeof(label), "linear scan %d", devices);
+	bench_report(label, elapse_stop(&time_ref), BENCH_CPU_OPS, BENCH_CPU_OPS * sizeof(uint32_t));
+
+	//# remove + register: the released slot is reused
+	elapse_start(&time_ref);
+	for (int i = 0; i < BENCH_CPU_OPS; i++) {
+		uint32_t uuid = bench_uuids[i % devices];
+		uuid_index_release(&index, uuid);
+		acc += uuid_index_acquire(&index, uuid, NULL);
+	}
+	snprintf(label, sizeof(label), "uuid_index_release+acquire %d", devices);
+	bench_report(label, elapse_stop(&time_ref), BENCH_CPU_OPS, BENCH_CPU_OPS * sizeof(uint32_t));
+	bench_sink = acc;
+}
+
+//###################################################
+//# SD KERNELS
+//###################################################
+
+static void bench_series_insert(const char *name, const char *path, int mode, int flags, int records) {
+	file_header_t header;
+	const int ops = records / AGGREGATE_SAMPLE_COUNT;
+	uint64_t time_ref;
+
+	series_handle_evict(path);
+	remove(path);
+
+	elapse_start(&time_ref);
+	for (int i = 0; i < ops; i++) {
+		record_t *batch = &bench_records[i * AGGREGATE_SAMPLE_COUNT];
+
+		if (mode == SERIES_MODE_FLAT) {
+			series_batch_insert(path, &header, batch, sizeof(record_t), AGGREGATE_SAMPLE_COUNT);
+		} else if (flags & SERIES_FLAG_COMPRESSED) {
+			series_compressed_insert(path, &header, batch, sizeof(record_t), AGGREGATE_SAMPLE_COUNT);
+		} else {
+			series_segment_insert(path, &header, batch, sizeof(record_t), AGGREGATE_SAMPLE_COUNT);
+		}
+	}
+	bench_report(name, elapse_stop(&time_ref), ops, ops * sizeof(record_t) * AGGREGATE_SAMPLE_COUNT);
+}
+
+static void bench_series_read(const char *name, const char *path) {
+	file_header_t header;
+	uint32_t t_mid = bench_records[BENCH_DAY_RECORDS / 2].timestamp;
+	int count = 0;
+	uint64_t time_ref;
+	char label[40];
+
+	//# read_all: the whole file in one call
+	elapse_start(&time_ref);
+	for (int i = 0; i < BENCH_IO_OPS / 10; i++) {
+		count = series_file_read_all(&header, path, bench_output, sizeof(record_t), BENCH_DAY_RECORDS);
+	}
+	snprintf(label, sizeof(label), "%s read_all", name);
+	bench_report(label, elapse_stop(&time_ref), BENCH_IO_OPS / 10, BENCH_IO_OPS / 10 * count * sizeof(record_t));
+
+	//# read_latest: the last hour
+	elapse_start(&time_ref);
+	for (int i = 0; i < BENCH_IO_OPS; i++) {
+		count = series_file_read_latest(path, bench_records[0].timestamp, bench_output, sizeof(record_t), 60);
+	}
+	snprintf(label, sizeof(label), "%s read_latest", name);
+	bench_report(label, elapse_stop(&time_ref), BENCH_IO_OPS, BENCH_IO_OPS * count * sizeof(record_t));
+
+	//# read_start: one hour from the middle of the day
+	elapse_start(&time_ref);
+	for (int i = 0; i < BENCH_IO_OPS; i++) {
+		count = series_file_read_start(path, t_mid, bench_output, sizeof(record_t), 60);
+	}
+	snprintf(label, sizeof(label), "%s read_start", name);
+	bench_report(label, elapse_stop(&time_ref), BENCH_IO_OPS, BENCH_IO_OPS * count * sizeof(record_t));
+}
+
+static void bench_entries_to_json() {
+	const int ops = BENCH_IO_OPS / 10;
+	uint32_t bytes = 0;
+	uint64_t time_ref;
+
+	elapse_start(&time_ref);
+	for (int i = 0; i < ops; i++) {
+		bytes += sd_entries_to_json(BENCH_DIR, bench_buffer, sizeof(bench_buffer));
+	}
+	bench_report("sd_entries_to_json", elapse_stop(&time_ref), ops, bytes);
+}
+
+static void benchmark_run() {
+	const uint32_t start = 1700000000;
+	bench_fill_records(start, BENCH_DAY_RECORDS);
+
+	ESP_LOGW(TAG, "CPU KERNELS");
+	bench_hex_to_uint32();
+	bench_rtc_get_date();
+	bench_aggregate_records();
+	bench_cache_inject_records();
+	bench_ingest_records();
+	bench_ingest_ring();
+	bench_fs_lock();
+	bench_device_configs_str();
+	bench_uuid_index(10);
+	bench_uuid_index(100);
+	bench_uuid_index(BENCH_INDEX_MAX);
+
+	if (!sd_ensure_dir(BENCH_DIR)) {
+		ESP_LOGE(TAG, "Err create %s", BENCH_DIR);
+		return;
+	}
+
+	//# flat files hold 340 records, the rest is a full day
+	ESP_LOGW(TAG, "SD KERNELS");
+	const int flat_records = (RECORD_FILE_BLOCK_SIZE - sizeof(file_header_t)) / sizeof(record_t);
+	bench_series_insert("insert flat", BENCH_DIR"/flat.bin", SERIES_MODE_FLAT, 0, flat_records);
+	bench_series_insert("insert segmented", BENCH_DIR"/segment.bin",
+		SERIES_MODE_SEGMENTED, 0, BENCH_DAY_RECORDS);
+	bench_series_insert("insert compressed", BENCH_DIR"/compress.bin",
+		SERIES_MODE_SEGMENTED, SERIES_FLAG_COMPRESSED, BENCH_DAY_RECORDS);
+
+	bench_series_read("flat", BENCH_DIR"/flat.bin");
+	bench_series_read("segmented", BENCH_DIR"/segment.bin");
+	bench_series_read("compressed", BENCH_DIR"/compress.bin");
+	bench_entries_to_json();
+
+	series_handle_evict(BENCH_DIR);
+	sd_remove_dir_recursive(BENCH_DIR);
+}
+
+void app_main(void) {
+	esp_err_t ret;
+	fs_lock_init(CONFIG_FS_LOCK_STRIPES);
+	series_handle_init();
+	device_pool_init(CONFIG_DEVICE_POOL_KB * 1024, CONFIG_AGGREGATE_POOL_KB * 1024, 0);
+
+	M_Spi_Conf spi_conf0 = {
+		.host = 1,
+		.mosi = CONFIG_SPI_MOSI,
+		.miso = CONFIG_SPI_MISO,
+		.clk = CONFIG_SPI_CLK,
+		.cs = -1,
+	};
+
+	ret = mod_spi_init(&spi_conf0, 20E6);
+	if (ret == ESP_OK) ret = sd_spi_config(spi_conf0.host, spi_conf0.cs);
+	if (ret != ESP_OK) {
+		ESP_LOGE(TAG, "Err SD mount: %s", esp_err_to_name(ret));
+	}
+
+	//# the kernels log every call, keep the output to the results
+	esp_log_level_set(TAG_SF, ESP_LOG_ERROR);
+	esp_log_level_set(TAG_RECORD, ESP_LOG_ERROR);
+
+	printf("\n\n=======================================\n");
+	printf("Storage Kernels Benchmark\n");
+	printf("=======================================\n");
+	printf("record_t: %dB, envelope_t: %dB, sample count: %d\n",
+			sizeof(record_t), sizeof(envelope_t), AGGREGATE_SAMPLE_COUNT);
+
+	for (;;) {
+		benchmark_run();
+		vTaskDelay(pdMS_TO_TICKS(10000));
+	}
+}
@@ -7,6 +7,9 @@
 #include "esp_timer.h"
 #include "esp_log.h"
 
+#include "rtc_helper.h"
+#include "series_file.h"
+
 //! WARNING !!!: writing to NVS and LittleFS cause wear on the flash chip
 //! Make sure to not run these tests too often (4+ seconds loop cycle)
 
@@ -86,6 +89,123 @@ void benchmark_read_test() {
 			(float)littlefs_read_time /nvs_read_time);
 }
 
+//# Series range query: binary search vs full read + filter
+#define QUERY_FILE_PATH "/littlefs/query.bin"
+#define QUERY_RECORD_SIZE 12
+#define QUERY_RECORD_COUNT (MAX_DATA_SIZE / QUERY_RECORD_SIZE)
+#define QUERY_RUNS 20
+
+static uint8_t query_records[QUERY_RECORD_COUNT * QUERY_RECORD_SIZE];
+
+void benchmark_series_query() {
+	static int file_ready = 0;
+	const uint32_t start_ts = 1767886318;
+
+	// create the file once (flash wear)
+	if (!file_ready) {
+		for (int i = 0; i < QUERY_RECORD_COUNT; i++) {
+			uint32_t timestamp = start_ts + i * 60;
+			memcpy(&query_records[i * QUERY_RECORD_SIZE], &timestamp, sizeof(timestamp));
+		}
+
+		file_header_t header;
+		remove(QUERY_FILE_PATH);
+		series_batch_insert(QUERY_FILE_PATH, &header, query_records,
+							QUERY_RECORD_SIZE, QUERY_RECORD_COUNT);
+		file_ready = 1;
+	}
+
+	// 30 minutes in the middle of the file
+	uint32_t t_start = start_ts + (QUERY_RECORD_COUNT / 2) * 60;
+	uint32_t t_end = t_start + 30 * 60;
+
+	//# 1. Full read + linear filter
+	int full_count = 0;
+	int64_t start = esp_timer_get_time();
+	for (int run = 0; run < QUERY_RUNS; run++) {
+		file_header_t header;
+		int len = series_file_read_all(&header, QUERY_FILE_PATH, query_records,
+									QUERY_RECORD_SIZE, QUERY_RECORD_COUNT);
+		full_count = 0;
+		for (int i = 0; i < len; i++) {
+			uint32_t timestamp;
+			memcpy(&timestamp, &query_records[i * QUERY_RECORD_SIZE], sizeof(timestamp));
+			if (timestamp >= t_start && timestamp <= t_end) full_count++;
+		}
+	}
+	int64_t full_time = (esp_timer_get_time() - start) / QUERY_RUNS;
+
+	//# 2. Binary search + bounded read
+	int query_count = 0;
+	start = esp_timer_get_time();
+	for (int run = 0; run < QUERY_RUNS; run++) {
+		query_count = series_file_query(QUERY_FILE_PATH, t_start, t_end, query_records,
+										QUERY_RECORD_SIZE, QUERY_RECORD_COUNT);
+	}
+	int64_t query_time = (esp_timer_get_time() - start) / QUERY_RUNS;
+
+	printf("\nQUERY %d/%d records: full read %lld us, binary search %lld us (%.1fx)\n",
+			query_count, full_count, full_time, query_time,
+			query_time ? (float)full_time / query_time : 0);
+}
+
+//# Series codec: encode/decode throughput of a day of 1 minute records
+#define CODEC_RECORD_COUNT 1440
+#define CODEC_RUNS 20
+
+static uint8_t codec_records[CODEC_RECORD_COUNT * QUERY_RECORD_SIZE];
+static uint8_t codec_decoded[CODEC_RECORD_COUNT * QUERY_RECORD_SIZE];
+static uint8_t codec_stream[CODEC_RECORD_COUNT * SERIES_CODEC_MAX_BYTES];
+
+void benchmark_series_codec() {
+	static int records_ready = 0;
+
+	// slow moving values sampled every minute
+	if (!records_ready) {
+		int16_t values[4] = {250, 500, 50, 0};
+		for (int i = 0; i < CODEC_RECORD_COUNT; i++) {
+			uint32_t timestamp = 1767886318 + i * 60;
+			values[0] += (i % 7) - 3;
+			values[1] += (i % 3) - 1;
+			values[2] = 50 + (i % 20);
+			memcpy(&codec_records[i * QUERY_RECORD_SIZE], &timestamp, sizeof(timestamp));
+			memcpy(&codec_records[i * QUERY_RECORD_SIZE + 4], values, sizeof(values));
+		}
+		records_ready = 1;
+	}
+
+	//# 1. Encode
+	size_t len = 0;
+	int encoded = 0;
+	int64_t start = esp_timer_get_time();
+	for (int run = 0; run < CODEC_RUNS; run++) {
+		series_codec_t state = {0};
+		len = series_encode(&state, codec_records, QUERY_RECORD_SIZE, CODEC_RECORD_COUNT,
+							codec_stream, sizeof(codec_stream), &encoded);
+	}
+	int64_t encode_time = (esp_timer_get_time() - start) / CODEC_RUNS;
+
+	//# 2. Decode
+	int decoded = 0;
+	start = esp_timer_get_time();
+	for (int run = 0; run < CODEC_RUNS; run++) {
+		series_codec_t state = {0};
+		size_t consumed;
+		decoded = series_decode(&state, codec_stream, len, codec_decoded,
+								QUERY_RECORD_SIZE, CODEC_RECORD_COUNT, &consumed);
+	}
+	int64_t decode_time = (esp_timer_get_time() - start) / CODEC_RUNS;
+
+	int match = decoded == encoded &&
+				memcmp(codec_records, codec_decoded, sizeof(codec_records)) == 0;
+	printf("\nCODEC %d records: %d -> %d bytes (%.1fx) %s\n", decoded,
+			sizeof(codec_records), len, (float)sizeof(codec_records) / len,
+			match ? "OK" : "MISMATCH");
+	printf("- encode %lld us (%.2f MB/s), decode %lld us (%.2f MB/s)\n",
+			encode_time, encode_time ? (float)sizeof(codec_records) / encode_time : 0,
+			decode_time, decode_time ? (float)sizeof(codec_records) / decode_time : 0);
+}
+
 void app_main() {
 	// Initialize storage first
 	esp_err_t ret = nvs_flash_init();
@@ -112,6 +232,8 @@ void app_main() {
 
 	for(;;) {
 		benchmark_read_test();
+		benchmark_series_query();
+		benchmark_series_codec();
 		vTaskDelay(pdMS_TO_TICKS(4000));
 	}
 }
@@ -0,0 +1,139 @@
+#!/usr/bin/env python3
+"""Concurrent /g_rec + /g_file load: FS busy rate and latency percentiles.
+
+Each client loops on its own device, alternating a whole day of /g_rec with a
+/g_file download of the same day file, while the storage writer keeps inserting.
+Before the striped FS lock every request took one mutex: a reader waited on the
+writer whatever device it wrote, and the losers got "FS busy". The http server
+runs one handler at a time, so the clients also queue behind each other: the
+busy rate measures the writer contention, the latencies include that queue.
+
+    python3 tools/fs_load.py 192.168.1.50 --clients 4 --seconds 30
+    python3 tools/fs_load.py 192.168.1.50 --devices AABBCCDA,AABBCCDB --no-file
+
+Before / after: run the baseline firmware with --save, then the new one against it
+
+    python3 tools/fs_load.py 192.168.1.50 --save before.json
+    python3 tools/fs_load.py 192.168.1.50 --baseline before.json
+
+A busy answer is a 500 (single mutex firmware) or a 503 with Retry-After
+(striped lock), both are counted as busy, other errors separately.
+"""
+import argparse
+import http.client
+import json
+import threading
+import time
+
+
+def day_file(uuid, day):
+    return f'*sdcard*log*{uuid}*{day.tm_year % 100:02d}*{day.tm_mon:02d}{day.tm_mday:02d}.bin'
+
+
+class Client(threading.Thread):
+    def __init__(self, host, port, uuid, deadline, with_file):
+        super().__init__(daemon=True)
+        self.host, self.port, self.uuid = host, port, uuid
+        self.deadline = deadline
+        self.with_file = with_file
+        self.latencies = {'g_rec': [], 'g_file': []}
+        self.busy = {'g_rec': 0, 'g_file': 0}
+        self.errors = 0
+
+    def get(self, conn, kind, path):
+        started = time.perf_counter()
+        conn.request('GET', path)
+        response = conn.getresponse()
+        response.read()
+        elapsed = time.perf_counter() - started
+
+        if response.status in (500, 503):
+            self.busy[kind] += 1
+        elif response.status not in (200, 404):
+            self.errors += 1
+        else:
+            self.latencies[kind].append(elapsed)
+
+    def run(self):
+        conn = http.client.HTTPConnection(self.host, self.port, timeout=10)
+        day = time.localtime()
+        rec = f'/g_rec?dev={self.uuid}&yr={day.tm_year}&mth={day.tm_mon}&day={day.tm_mday}&win=1440'
+        file = f'/g_file?path={day_file(self.uuid, day)}'
+
+        while time.perf_counter() < self.deadline:
+            try:
+                self.get(conn, 'g_rec', rec)
+                if self.with_file:
+                    self.get(conn, 'g_file', file)
+            except (OSError, http.client.HTTPException):
+                self.errors += 1
+                conn.close()
+                conn = http.client.HTTPConnection(self.host, self.port, timeout=10)
+
+
+def percentile(values, p):
+    if not values:
+        return 0
+    values = sorted(values)
+    return values[min(len(values) - 1, int(len(values) * p))]
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('host')
+    parser.add_argument('--port', type=int, default=80)
+    parser.add_argument('--devices', default='AABBCCDA,AABBCCDB,AABBCCDD,AABBCCE0',
+                        help='comma separated uuids (hex), one client each')
+    parser.add_argument('--clients', type=int, help='clients (default: one per device)')
+    parser.add_argument('--seconds', type=float, default=20)
+    parser.add_argument('--no-file', action='store_true', help='/g_rec only')
+    parser.add_argument('--save', help='write the results to this json file')
+    parser.add_argument('--baseline', help='json results of an earlier run (--save) to compare with')
+    args = parser.parse_args()
+
+    uuids = args.devices.split(',')
+    count = args.clients or len(uuids)
+    deadline = time.perf_counter() + args.seconds
+    clients = [Client(args.host, args.port, uuids[i % len(uuids)], deadline, not args.no_file)
+               for i in range(count)]
+
+    for client in clients:
+        client.start()
+    for client in clients:
+        client.join()
+
+    baseline = {}
+    if args.baseline:
+        with open(args.baseline) as f:
+            baseline = json.load(f)
+
+    errors = sum(client.errors for client in clients)
+    results = {}
+    for kind in ('g_rec', 'g_file'):
+        latencies = [value for client in clients for value in client.latencies[kind]]
+        busy = sum(client.busy[kind] for client in clients)
+        total = len(latencies) + busy
+        if not total:
+            continue
+        result = results[kind] = {
+            'requests': total,
+            'busy_rate': busy / total,
+            'p50_ms': percentile(latencies, 0.5) * 1000,
+            'p99_ms': percentile(latencies, 0.99) * 1000,
+        }
+        print(f'- /{kind}: {total} requests, {busy} busy ({result["busy_rate"]:.1%}), '
+              f'p50 {result["p50_ms"]:.0f} ms, p99 {result["p99_ms"]:.0f} ms')
+
+        before = baseline.get(kind)
+        if before:
+            print(f'  before: busy {before["busy_rate"]:.1%}, '
+                  f'p50 {before["p50_ms"]:.0f} ms, p99 {before["p99_ms"]:.0f} ms')
+    print(f'- {count} clients, {args.seconds:.0f}s, {errors} other errors')
+
+    if args.save:
+        with open(args.save, 'w') as f:
+            json.dump(results, f, indent=1)
+
+
+if __name__ == '__main__':
+    main()
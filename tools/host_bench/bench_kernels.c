@@ -0,0 +1,294 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "series_codec.h"
+#include "uuid_index.h"
+#include "ingest_ring.h"
+#include "lttb.h"
+
+//! Host benchmarks of the pure C storage kernels (same cases as main/test_benchmark.c)
+// each case runs a kernel N times and prints ns/op and bytes/op, then checks the results:
+// the exit code is the failed checks, CI runs it on every push
+// the figures are the host CPU, not the ESP32: compare runs of the same machine
+
+#define BENCH_CPU_OPS 2000000
+#define BENCH_DAY_RECORDS 1440						// 1 minute records of one day
+
+typedef struct __attribute__((packed)) {
+	uint32_t timestamp;
+	int16_t value1;
+	int16_t value2;
+	int16_t value3;
+	int16_t value4;
+} bench_record_t;									// record_t layout (12 bytes)
+
+static volatile uint32_t bench_sink;				// keeps the results alive at -O2
+static int bench_failed;
+
+static void elapse_start(uint64_t *timestamp) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	*timestamp = (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+// returns ns (the device helper returns us)
+static uint64_t elapse_stop(uint64_t *timestamp) {
+	uint64_t now;
+	elapse_start(&now);
+	return now - *timestamp;
+}
+
+static void bench_report(const char *name, uint64_t elapsed_ns, uint32_t ops, uint32_t bytes) {
+	printf("- %-32s %8ld ops %10.1f ns/op %8ld B/op\n",
+		name, (long)ops, (double)elapsed_ns / ops, (long)(bytes / ops));
+}
+
+static void bench_check(const char *name, int ok) {
+	if (!ok) {
+		printf("- %-32s FAIL\n", name);
+		bench_failed++;
+	}
+}
+
+//###################################################
+//# SERIES CODEC
+//###################################################
+
+//# encode/decode throughput of a day of 1 minute records (main/test_storage.c: benchmark_series_codec)
+#define CODEC_RUNS 2000
+
+static bench_record_t codec_records[BENCH_DAY_RECORDS];
+static bench_record_t codec_decoded[BENCH_DAY_RECORDS];
+static uint8_t codec_stream[BENCH_DAY_RECORDS * SERIES_CODEC_MAX_BYTES];
+
+static void bench_series_codec() {
+	// slow moving values sampled every minute
+	int16_t values[4] = {250, 500, 50, 0};
+	for (int i = 0; i < BENCH_DAY_RECORDS; i++) {
+		values[0] += (i % 7) - 3;
+		values[1] += (i % 3) - 1;
+		values[2] = 50 + (i % 20);
+		codec_records[i] = (bench_record_t){ 1767886318 + i * 60, values[0], values[1], values[2], values[3] };
+	}
+
+	size_t len = 0;
+	int encoded = 0;
+	uint64_t time_ref;
+	elapse_start(&time_ref);
+	for (int run = 0; run < CODEC_RUNS; run++) {
+		series_codec_t state = {0};
+		len = series_encode(&state, codec_records, sizeof(bench_record_t), BENCH_DAY_RECORDS,
+							codec_stream, sizeof(codec_stream), &encoded);
+	}
+	bench_report("series_encode (per record)", elapse_stop(&time_ref), CODEC_RUNS * BENCH_DAY_RECORDS, CODEC_RUNS * sizeof(codec_records));
+
+	int decoded = 0;
+	elapse_start(&time_ref);
+	for (int run = 0; run < CODEC_RUNS; run++) {
+		series_codec_t state = {0};
+		size_t consumed;
+		decoded = series_decode(&state, codec_stream, len, codec_decoded,
+								sizeof(bench_record_t), BENCH_DAY_RECORDS, &consumed);
+	}
+	bench_report("series_decode (per record)", elapse_stop(&time_ref), CODEC_RUNS * BENCH_DAY_RECORDS, CODEC_RUNS * sizeof(codec_records));
+
+	printf("- codec: %d records, %ld -> %ld bytes (%.1fx)\n", decoded,
+			(long)sizeof(codec_records), (long)len, len ? (double)sizeof(codec_records) / len : 0);
+	bench_check("series codec round trip", encoded == BENCH_DAY_RECORDS && decoded == encoded &&
+				memcmp(codec_records, codec_decoded, sizeof(codec_records)) == 0);
+}
+
+//###################################################
+//# UUID INDEX
+//###################################################
+
+//# uuid lookups: hash index vs the linear scan it replaced (hits and misses)
+#define BENCH_INDEX_MAX 1000
+
+static uint32_t bench_uuids[BENCH_INDEX_MAX];
+static uint32_t bench_index_keys[UUID_INDEX_SIZE(BENCH_INDEX_MAX)];
+static uint16_t bench_index_slots[UUID_INDEX_SIZE(BENCH_INDEX_MAX)];
+static uint16_t bench_free_slots[BENCH_INDEX_MAX];
+
+static void bench_uuid_index(int devices) {
+	uuid_index_t index = UUID_INDEX_INIT(bench_index_keys, bench_index_slots, bench_free_slots, devices);
+	uuid_index_clear(&index);
+
+	for (int i = 0; i < devices; i++) {
+		bench_uuids[i] = 0xAABB0000 + i * 7;
+		uuid_index_acquire(&index, bench_uuids[i], NULL);
+	}
+
+	uint32_t acc = 0;
+	uint64_t time_ref;
+	char label[40];
+
+	//# every other lookup misses (uuid not registered)
+	elapse_start(&time_ref);
+	for (int i = 0; i < BENCH_CPU_OPS; i++) {
+		uint32_t uuid = bench_uuids[i % devices] + (i & 1);
+		acc += uuid_index_find(&index, uuid);
+	}
+	snprintf(label, sizeof(label), "uuid_index_find %d", devices);
+	bench_report(label, elapse_stop(&time_ref), BENCH_CPU_OPS, BENCH_CPU_OPS * sizeof(uint32_t));
+
+	elapse_start(&time_ref);
+	for (int i = 0; i < BENCH_CPU_OPS; i++) {
+		uint32_t uuid = bench_uuids[i % devices] + (i & 1);
+		for (int j = 0; j < devices; j++) {
+			if (bench_uuids[j] == uuid) {
+				acc += j;
+				break;
+			}
+		}
+	}
+	snprintf(label, sizeof(label), "linear scan %d", devices);
+	bench_report(label, elapse_stop(&time_ref), BENCH_CPU_OPS, BENCH_CPU_OPS * sizeof(uint32_t));
+
+	//# remove + register: the released slot is reused
+	elapse_start(&time_ref);
+	for (int i = 0; i < BENCH_CPU_OPS; i++) {
+		uint32_t uuid = bench_uuids[i % devices];
+		uuid_index_release(&index, uuid);
+		acc += uuid_index_acquire(&index, uuid, NULL);
+	}
+	snprintf(label, sizeof(label), "uuid_index_release+acquire %d", devices);
+	bench_report(label, elapse_stop(&time_ref), BENCH_CPU_OPS, BENCH_CPU_OPS * sizeof(uint32_t));
+	bench_sink = acc;
+
+	//# every uuid still maps to one distinct slot, the misses stay misses
+	int ok = index.count == devices;
+	for (int i = 0; i < devices && ok; i++) {
+		int slot = uuid_index_find(&index, bench_uuids[i]);
+		ok = slot >= 0 && slot < devices && uuid_index_find(&index, bench_uuids[i] + 1) < 0;
+		for (int j = 0; j < i && ok; j++) ok = uuid_index_find(&index, bench_uuids[j]) != slot;
+	}
+	snprintf(label, sizeof(label), "uuid_index check %d", devices);
+	bench_check(label, ok);
+}
+
+//###################################################
+//# INGEST RING
+//###################################################
+
+#define INGEST_DRAIN_BATCH 64						// mod_sd.h: tuples applied per INGEST_MUTEX hold
+
+typedef struct __attribute__((packed)) {
+	uint32_t uuid;
+	bench_record_t record;
+} bench_tuple_t;									// ingest_tuple_t layout
+
+//# producer cost of the lock-free ring: one push + one batched pop per record
+static void bench_ingest_ring() {
+	static bench_tuple_t batch[INGEST_DRAIN_BATCH];
+	ingest_ring_t ring;
+	if (!ingest_ring_create(&ring, 1024, sizeof(bench_tuple_t), INGEST_RING_REJECT)) {
+		bench_check("ingest_ring create", 0);
+		return;
+	}
+
+	bench_tuple_t tuple = { .uuid = 0xAABBCCDA };
+	uint32_t expected = 0;
+	int ok = 1;
+	uint64_t time_ref;
+	elapse_start(&time_ref);
+	for (int i = 0; i < BENCH_CPU_OPS; i++) {
+		tuple.record.timestamp = i;
+		ingest_ring_push(&ring, &tuple);
+		if ((i + 1) % INGEST_DRAIN_BATCH == 0) {
+			int n = ingest_ring_pop_batch(&ring, batch, INGEST_DRAIN_BATCH);
+			for (int j = 0; j < n; j++) ok &= batch[j].record.timestamp == expected++;
+		}
+	}
+	bench_report("ingest_ring push+pop", elapse_stop(&time_ref), BENCH_CPU_OPS, BENCH_CPU_OPS * sizeof(bench_tuple_t));
+	bench_check("ingest_ring order", ok && expected == BENCH_CPU_OPS && ring.rejected == 0);
+	ingest_ring_free(&ring);
+
+	//# full ring: REJECT keeps the oldest items, DROP_OLDEST the latest ones
+	for (int policy = INGEST_RING_REJECT; policy <= INGEST_RING_DROP_OLDEST; policy++) {
+		if (!ingest_ring_create(&ring, 8, sizeof(bench_tuple_t), policy)) continue;
+		for (int i = 0; i < 12; i++) {
+			tuple.record.timestamp = i;
+			ingest_ring_push(&ring, &tuple);
+		}
+		const uint32_t first = policy == INGEST_RING_REJECT ? 0 : 4;
+		int n = ingest_ring_pop_batch(&ring, batch, INGEST_DRAIN_BATCH);
+		ok = n == 8 && (policy == INGEST_RING_REJECT ? ring.rejected : ring.dropped) == 4;
+		for (int j = 0; j < n && ok; j++) ok = batch[j].record.timestamp == first + j;
+		bench_check(policy == INGEST_RING_REJECT ? "ingest_ring reject" : "ingest_ring drop oldest", ok);
+		ingest_ring_free(&ring);
+	}
+}
+
+//###################################################
+//# LTTB
+//###################################################
+
+#define LTTB_RUNS 2000
+#define LTTB_POINTS 100
+
+static bench_record_t lttb_records[BENCH_DAY_RECORDS];
+
+typedef struct {
+	int count;
+	uint32_t last_timestamp;
+	int ordered;
+	int peak;										// the spike series was kept
+} lttb_sink_t;
+
+static int bench_lttb_emit(void *ctx, const uint8_t *series) {
+	lttb_sink_t *sink = (lttb_sink_t*)ctx;
+	bench_record_t record;
+	memcpy(&record, series, sizeof(record));
+	if (sink->count && record.timestamp <= sink->last_timestamp) sink->ordered = 0;
+	if (record.value1 == 30000) sink->peak = 1;
+	sink->last_timestamp = record.timestamp;
+	sink->count++;
+	return 1;
+}
+
+//# a day of 1 minute records down to LTTB_POINTS, pushed in blocks as the query reads them
+static void bench_lttb() {
+	const uint32_t start = 1767886318;
+	for (int i = 0; i < BENCH_DAY_RECORDS; i++) {
+		lttb_records[i] = (bench_record_t){ start + i * 60, (int16_t)(250 + (i % 7) - 3), 500, (int16_t)(i % 100), 0 };
+	}
+	lttb_records[777].value1 = 30000;				// one spike: every k-th sample drops it
+
+	static lttb_t lttb;
+	lttb_sink_t sink = {0};
+	uint32_t acc = 0;
+	uint64_t time_ref;
+	elapse_start(&time_ref);
+	for (int run = 0; run < LTTB_RUNS; run++) {
+		sink = (lttb_sink_t){ .ordered = 1 };
+		lttb_init(&lttb, start, start + (BENCH_DAY_RECORDS - 1) * 60, LTTB_POINTS,
+					sizeof(bench_record_t), 0, bench_lttb_emit, &sink);
+		for (int i = 0; i < BENCH_DAY_RECORDS; i += 64) {
+			int count = BENCH_DAY_RECORDS - i < 64 ? BENCH_DAY_RECORDS - i : 64;
+			lttb_push(&lttb, &lttb_records[i], count);
+		}
+		acc += lttb_finish(&lttb);
+	}
+	bench_report("lttb 1440 -> 100", elapse_stop(&time_ref), LTTB_RUNS, LTTB_RUNS * sizeof(lttb_records));
+	bench_sink = acc;
+
+	bench_check("lttb check", sink.count == LTTB_POINTS && sink.ordered && sink.peak &&
+				sink.last_timestamp == lttb_records[BENCH_DAY_RECORDS - 1].timestamp);
+}
+
+int main() {
+	printf("\nHOST KERNELS\n");
+	bench_series_codec();
+	bench_uuid_index(16);
+	bench_uuid_index(256);
+	bench_uuid_index(BENCH_INDEX_MAX);
+	bench_ingest_ring();
+	bench_lttb();
+
+	printf("\n%s: %d check(s) failed\n", bench_failed ? "FAIL" : "OK", bench_failed);
+	return bench_failed;
+}
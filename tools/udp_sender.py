@@ -0,0 +1,132 @@
+#!/usr/bin/env python3
+"""Sender for the UDP ingest listener (mod_udp.h), finds the maximum sustainable packet rate.
+
+Datagram, little endian: header (uint16 magic 0x5352, uint8 version 1, uint8 count,
+uint32 sequence) then count tuples (uint32 uuid, uint32 timestamp, int16 value1..value4).
+A datagram with count 0 asks for the listener stats (one json line back).
+
+    python3 tools/udp_sender.py 192.168.1.50                 # ramp up the rate
+    python3 tools/udp_sender.py 127.0.0.1 --rate 2000        # one fixed rate step
+    python3 tools/udp_sender.py 127.0.0.1 --check            # gap / duplicate detection
+
+Each rate step sends for --seconds, then compares the datagrams sent with the ones the
+listener counted: the maximum sustainable rate is the last step under --max-loss.
+Devices must be registered (/s_config) for their records to be accepted.
+"""
+import argparse
+import json
+import socket
+import struct
+import time
+
+HEADER = struct.Struct('<HBBI')
+TUPLE = struct.Struct('<IIhhhh')
+MAGIC = 0x5352
+VERSION = 1
+
+
+class Sender:
+    def __init__(self, host, port, uuid, records):
+        self.addr = (host, port)
+        self.uuid = uuid
+        self.records = records
+        self.sequence = 0
+        self.timestamp = int(time.time()) - 3600
+        self.sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        self.sock.settimeout(2)
+
+    def datagram(self, sequence):
+        body = bytearray(HEADER.pack(MAGIC, VERSION, self.records, sequence))
+        for _ in range(self.records):
+            self.timestamp += 1
+            body += TUPLE.pack(self.uuid, self.timestamp, 25, 60, 50, 0)
+        return bytes(body)
+
+    def send(self, sequence=None):
+        if sequence is None:
+            self.sequence += 1
+            sequence = self.sequence
+        self.sock.sendto(self.datagram(sequence), self.addr)
+
+    def stats(self):
+        self.sock.sendto(HEADER.pack(MAGIC, VERSION, 0, 0), self.addr)
+        return json.loads(self.sock.recvfrom(1024)[0])
+
+
+def run_step(sender, rate, seconds):
+    before = sender.stats()
+    interval = 1.0 / rate
+    sent = 0
+    started = time.perf_counter()
+    deadline = started + seconds
+
+    while True:
+        now = time.perf_counter()
+        if now >= deadline:
+            break
+        # catch up in bursts when the sleep overshoots
+        due = int((now - started) / interval) + 1
+        while sent < due:
+            sender.send()
+            sent += 1
+        time.sleep(max(0.0, started + sent * interval - time.perf_counter()))
+
+    time.sleep(0.5)                     # let the listener drain its socket
+    after = sender.stats()
+    received = after['datagrams'] - before['datagrams']
+    return sent, received, after
+
+
+def check(sender):
+    sender.send(1)
+    sender.send(2)
+    sender.send(2)                      # duplicate
+    sender.send(5)                      # gap: 3, 4 lost
+    sender.send(4)                      # late
+    time.sleep(0.2)
+    stats = sender.stats()
+    print(json.dumps(stats))
+    return stats
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('host')
+    parser.add_argument('--port', type=int, default=5005)
+    parser.add_argument('--uuid', default='AABBCCDA', help='sender uuid (hex)')
+    parser.add_argument('--records', type=int, default=10, help='records per datagram (1-90)')
+    parser.add_argument('--rate', type=int, help='datagrams per second, one step only')
+    parser.add_argument('--start', type=int, default=250, help='first rate of the ramp')
+    parser.add_argument('--seconds', type=float, default=3)
+    parser.add_argument('--max-loss', type=float, default=0.01)
+    parser.add_argument('--check', action='store_true', help='send a duplicate, a gap and a late datagram')
+    args = parser.parse_args()
+
+    sender = Sender(args.host, args.port, int(args.uuid, 16), args.records)
+    if args.check:
+        check(sender)
+        return
+
+    rate = args.rate or args.start
+    best = 0
+    while True:
+        sent, received, stats = run_step(sender, rate, args.seconds)
+        loss = 1 - received / sent if sent else 0
+        print(f'- {rate:6d}/s: sent {sent}, received {received}, loss {loss:.1%}, '
+              f'listener {stats["avg_us"]} us avg / {stats["max_us"]} us max')
+        if loss > args.max_loss:
+            break
+        best = min(rate, int(received / args.seconds))
+        if args.rate:
+            break
+        if sent < rate * args.seconds * 0.9:
+            print('- the sender can not go faster: the listener keeps up with it')
+            break
+        rate *= 2
+
+    print(f'- max sustainable: {best} datagrams/s = {best * args.records} records/s '
+          f'({args.records} records a datagram)')
+
+
+if __name__ == '__main__':
+    main()
@@ -301,9 +301,11 @@ async function reload_records(chart_id) {
 			mth: today.getMonth() + 1,						// month
 			day: today.getDate(),							// day
 			win: get_timeWindow(chart_id).value, 			// time window
-			minT: 1767886318,	// min time
-			maxT: chartObjs[chart_id].record_max_time || 0,	// max time
+			// minT / maxT: an explicit range (up to 31 days) instead of the window
 		})
+		// one point per pixel: longer windows come back downsampled (LTTB), peaks kept
+		const plotWidth = Math.round(chartObjs[chart_id].plot?.width || 0)
+		if (plotWidth > 0) params.set('pts', plotWidth)
 		// indexDB_setup(chart_id)
 
 		try {